@@ -26,6 +26,7 @@
 #include <stdlib.h>
 #include <errno.h>
 #include <math.h>
+#include <limits.h>
 
 #include <sys/types.h>
 
@@ -65,18 +66,161 @@ int get_preset(const char *ptr, fsrc_preset *pre)
 	return 0;
 }
 
+#define MAX_WARM_RATES 32
+#define MAX_WARM_PRESETS 8
+
+/* parses a comma separated list of presets */
+int get_presets(const char *ptr, fsrc_preset *pre, size_t *n)
+{
+	char name[16];
+	*n = 0;
+	for(;;) {
+		size_t len = strcspn(ptr, ",");
+		if(len == 0 || len >= sizeof(name) || *n == MAX_WARM_PRESETS)
+			return 1;
+		memcpy(name, ptr, len);
+		name[len] = 0;
+		if(get_preset(name, &pre[(*n)++]))
+			return 1;
+		if(!ptr[len])
+			return 0;
+		ptr += len + 1;
+	}
+}
+
+/* parses a comma separated list of converter flags */
+int get_flags(const char *ptr, int *flags)
+{
+	static const struct { const char *name; int flag; } names[] = {
+		{ "fft", FSRC_USE_FFT },
+		{ "double", FSRC_DOUBLE },
+		{ "fixed", FSRC_FIXED },
+		{ "mixed", FSRC_MIXED },
+		{ "tables", FSRC_CACHE_TABLES },
+		{ "floats", FSRC_CACHE_FLOATS },
+		{ "none", 0 }
+	};
+
+	*flags = 0;
+	for(;;) {
+		size_t len = strcspn(ptr, ",");
+		size_t i = 0;
+		while(i < sizeof(names) / sizeof(names[0]) && (strlen(names[i].name) != len || strncmp(names[i].name, ptr, len)))
+			++i;
+		if(i == sizeof(names) / sizeof(names[0]))
+			return 1;
+		*flags |= names[i].flag;
+		if(!ptr[len])
+			return 0;
+		ptr += len + 1;
+	}
+}
+
+/* the buffer size for rate, given its length in milliseconds */
+size_t get_bufsize(unsigned rate, unsigned msec)
+{
+	size_t size = (size_t)((unsigned long long)rate * msec / 1000);
+	return size ? size : 1;
+}
+
+/* parses a comma separated list of sample rates */
+int get_rates(const char *ptr, unsigned *rates, size_t *n)
+{
+	*n = 0;
+	for(;;) {
+		char *end;
+		unsigned long r = strtoul(ptr, &end, 10);
+		if(end == ptr || r == 0 || r > UINT_MAX || *n == MAX_WARM_RATES)
+			return 1;
+		rates[(*n)++] = (unsigned)r;
+		if(!*end)
+			return 0;
+		if(*end != ',')
+			return 1;
+		ptr = end + 1;
+	}
+}
+
 void usage()
 {
 	printf(
 		"Usage:\n\t"
 		"fsrctool -q preset_name -i input_file -o output_file -r sample_rate\n\t"
-		"fsrctool -p passband_ripple -s stopband_atten -b bandwidth -i input_file -o output_file -r sample_rate\n\n"
+		"fsrctool -p passband_ripple -s stopband_atten -b bandwidth -i input_file -o output_file -r sample_rate\n\t"
+		"fsrctool -w sample_rates -q preset_names\n\t"
+		"fsrctool -w sample_rates -p passband_ripple -s stopband_atten -b bandwidth\n\n"
+		"each optionally followed by -f flag_names -m buffer_length\n\n"
 		"where :\n\t"
 		"preset_name can be one of mq16, hq16, mq20, hq20, mq24, hq24\n\t"
 		"passband_ripple is the peak-to-peak ripple in dB\n\t"
 		"stopband_atten is the stopband attenuation in dB (positive)\n\t"
 		"bandwidth is the passband width in (0, 1), where 1 is the Nyquist frequency\n\t"
-		"sample_rate is the output rate\n");
+		"sample_rate is the output rate\n"
+		"flag_names is a comma separated list of fft, double, fixed, mixed, tables,\n"
+		"floats or none, fft,double by default\n"
+		"buffer_length is the i/o buffer length in milliseconds, 1000 by default\n\n"
+		"-w fills the design cache for converting between any two of the comma\n"
+		"separated sample_rates, at each of the comma separated preset_names,\n"
+		"so later conversions don't have to design anything. conversions made with\n"
+		"the same -f and -m find everything there\n\n"
+		"-c cache_dir uses the design cache in cache_dir, which must exist,\n"
+		"instead of the one in the home directory\n");
+}
+
+/* designs every conversion between the rates, at each quality */
+int warm_cache(fsrc_cache *cache, const unsigned *rates, size_t nr, const fsrc_preset *pre, size_t np, const fsrc_spec *custom, 
+	int flags, unsigned msec)
+{
+	size_t nq = custom ? 1 : np;
+	fsrc_spec *specs = (fsrc_spec*)malloc(nr * nr * nq * sizeof(fsrc_spec));
+	fsrc_err *errs = (fsrc_err*)malloc(nr * nr * nq * sizeof(fsrc_err));
+	if(!specs || !errs) {
+		printf("error: no memory\n");
+		free(specs);
+		free(errs);
+		return EXIT_FAILURE;
+	}
+
+	size_t n = 0;
+	for(size_t i = 0; i < nr; ++i) {
+		for(size_t j = 0; j < nr; ++j) {
+			if(rates[i] == rates[j])
+				continue;
+			for(size_t k = 0; k < nq; ++k) {
+				fsrc_spec *spec = &specs[n];
+				if(custom) 
+					*spec = *custom;
+				else
+					memset(spec, 0, sizeof(fsrc_spec));
+				if(fsrc_freq_ratio(rates[i], rates[j], &spec->fr) != FSRC_S_OK)
+					continue;
+				if(!custom)
+					fsrc_load_preset(spec->fr, pre[k], spec);
+				spec->isize = get_bufsize(rates[i], msec);
+				spec->osize = get_bufsize(rates[j], msec);
+				spec->flags = flags;
+				++n;
+			}
+		}
+	}
+
+	int ret = EXIT_SUCCESS;
+	if(n == 0) {
+		printf("nothing to design\n");
+	} else if(fsrc_cache_design_batch(cache, specs, n, errs) != FSRC_S_OK) {
+		size_t nerr = 0;
+		for(size_t i = 0; i < n; ++i) {
+			if(errs[i] != FSRC_S_OK)
+				++nerr;
+		}
+		printf("%u of %u designs failed\n", (unsigned)nerr, (unsigned)n);
+		ret = EXIT_FAILURE;
+	}
+
+	free(specs);
+	free(errs);
+
+	return ret;
 }
 
 int main(int argc, char *argv[])
@@ -86,15 +230,20 @@ int main(int argc, char *argv[])
 	fsrc_spec spec;
 	fsrc_bufdesc idesc, odesc;
 	fsrc_err err;
-	size_t got, wrote, rem, isize, osize, bsize;
+	size_t got, wrote, isize, osize, bsize;
 	unsigned irate, orate, chans, end;
 	int ret;
-	char *idata, *odata, *wptr, *home;
-	char *ipath, *opath;
+	char *idata, *odata, *home;
+	char *ipath, *opath, *cpath, *wrates;
 	fsrc_cache *cache;
-	fsrc_preset pre;
+	fsrc_preset pre[MAX_WARM_PRESETS];
+	size_t npre;
+	unsigned rates[MAX_WARM_RATES];
+	size_t nrates;
 	fsrc_converter *cvt;	
 	double d;
+	int flags;
+	unsigned msec;
 
 	ret = EXIT_FAILURE;
 
@@ -105,8 +254,10 @@ int main(int argc, char *argv[])
 
 	memset(&spec, 0, sizeof(spec));
 
-	ipath = opath = 0;
-	irate = 0;
+	ipath = opath = cpath = wrates = 0;
+	irate = orate = 0;
+	flags = FSRC_DOUBLE | FSRC_USE_FFT;
+	msec = 1000;
 
 	int params = 0;
 	int gotpre = 0;
@@ -128,7 +279,7 @@ int main(int argc, char *argv[])
 			opath = argv[++i];
 			break;
 		case 'q':
-			if(get_preset(argv[++i], &pre)) {
+			if(get_presets(argv[++i], pre, &npre)) {
 				printf("bad preset name\n\n");
 				usage();
 				return ret;
@@ -169,6 +320,31 @@ int main(int argc, char *argv[])
 				return ret;
 			}
 			break;
+		case 'w':
+			wrates = argv[++i];
+			if(get_rates(wrates, rates, &nrates)) {
+				printf("invalid sample rate list\n\n");
+				usage();
+				return ret;
+			}
+			break;
+		case 'c':
+			cpath = argv[++i];
+			break;
+		case 'f':
+			if(get_flags(argv[++i], &flags)) {
+				printf("invalid flag names\n\n");
+				usage();
+				return ret;
+			}
+			break;
+		case 'm':
+			if(sscanf(argv[++i], "%u", &msec) != 1 || msec == 0 || msec > 60000) {
+				printf("invalid buffer length\n\n");
+				usage();
+				return ret;
+			}
+			break;
 		default:
 			printf("invalid argument: %s\n\n", argv[i]);
 			usage();
@@ -197,14 +373,26 @@ int main(int argc, char *argv[])
 		printf("specify either a quality preset or specs\n");
 	}
 
-	if(!ipath) {
+	if(gotpre && npre > 1 && !wrates) {
 		++nerr;
-		printf("input not specified\n");
+		printf("more than one preset only makes sense with -w\n");
 	}
 
-	if(!opath) {
-		++nerr;
-		printf("output not specified\n");		
+	if(wrates) {
+		if(ipath || opath || orate) {
+			++nerr;
+			printf("-w doesn't convert anything, -i, -o and -r don't apply\n");
+		}
+	} else {
+		if(!ipath) {
+			++nerr;
+			printf("input not specified\n");
+		}
+
+		if(!opath) {
+			++nerr;
+			printf("output not specified\n");		
+		}
 	}
 
 	if(nerr) {
@@ -233,15 +421,26 @@ int main(int argc, char *argv[])
 
 	cache = 0;
 
-	home = gethomedir();
-	if(!home) {
+	home = cpath ? 0 : gethomedir();
+	if(!cpath && !home) {
 		printf("warning: cannot get home directory\n");
 	} else {
-		if(fsrc_cache_create_dir(&cache, home, CACHE_MODE, 1) != FSRC_S_OK) {
+		if(fsrc_cache_create_dir(&cache, cpath ? cpath : home, CACHE_MODE, 1) != FSRC_S_OK) {
 			printf("warning: fsrc_cache_create_dir failed\n");
 		}
 	}
 
+	if(wrates) {
+		if(!cache) {
+			printf("error: no design cache to fill\n");
+		} else {
+			ret = warm_cache(cache, rates, nrates, pre, npre, gotpre ? 0 : &spec, flags, msec);
+			fsrc_cache_destroy(cache);
+		}
+		free(home);
+		return ret;
+	}
+
 	src = dst = 0;
 	idata = 0;
 	odata = 0;
@@ -267,15 +466,15 @@ int main(int argc, char *argv[])
 		goto cleanup;
 	}
 
-	isize = irate;						/* 1 second long buffers */
-	osize = orate;
+	isize = get_bufsize(irate, msec);
+	osize = get_bufsize(orate, msec);
 
 	if(fsrc_freq_ratio(irate, orate, &spec.fr) != FSRC_S_OK) {
 		printf("invalid conversion ratio\n");
 		goto cleanup;
 	}
 
-	if(gotpre) fsrc_load_preset(spec.fr, pre, &spec);
+	if(gotpre) fsrc_load_preset(spec.fr, pre[0], &spec);
 
 	spec.isize = isize;					/* set max internal i/o buffer capacity */
 	spec.osize = osize;
@@ -290,7 +489,7 @@ int main(int argc, char *argv[])
 	spec.bw = .95;						/* preserve 95% of the bandwidth below the Nyquist rate */
 #endif
 
-	spec.flags = FSRC_DOUBLE | FSRC_USE_FFT;			/* ! */
+	spec.flags = flags;
 
 	chans = fmt.chans;
 	if(fsrc_create(cache, &cvt, &spec, chans) != FSRC_S_OK) {
@@ -313,8 +512,6 @@ int main(int argc, char *argv[])
 	}
 
 	memset(&idesc, 0, sizeof(idesc));
-	idesc.size = 0; /* input buffer write position */
-	idesc.data = idata;
 	idesc.fmt = fmt.sample_fmt;
 	
 	memset(&odesc, 0, sizeof(odesc));
@@ -324,47 +521,36 @@ int main(int argc, char *argv[])
 
 	end = 0;
 	for(;;) {
-		if(!end) {
-			rem = isize - idesc.size;
-			wptr = idata + idesc.size * bsize;
-
-			got = fsrc_wave_read(src, wptr, rem);
-			idesc.size += got;
+		if(!end && idesc.size == 0) {
+			got = fsrc_wave_read(src, idata, isize);
+			end = got < isize;  /* flag EOF or something */		
 
-			end = got < rem;  /* flag EOF or something */		
-			if(end && idesc.size == 0) {
-				fsrc_end(cvt); /* tell the converter it won't get any more samples */	
-			}
-		}
-		
-		if(idesc.size) {
-			got = fsrc_read(cvt, &idesc);
-			assert(got); /* shouldn't be 0 at this point */
-			idesc.size -= got;
-			if(idesc.size) {
-				/* move remaining data to the beginning of the buffer */
-				memmove(idata, idata + got * bsize, idesc.size * bsize);
-			} else if (end) {
-				fsrc_end(cvt); /* tell the converter it won't get any more samples */	
-			}
+			idesc.data = idata;
+			idesc.size = got;
 		}
 
-		err = fsrc_process(cvt);
-		if(err == FSRC_S_END) {
-			assert(end);
+		/* whatever fits */
+		got = fsrc_push(cvt, &idesc);
+		idesc.data = (char*)idesc.data + got * bsize;
+		idesc.size -= got;
+
+		if(end && idesc.size == 0)
+			fsrc_end(cvt); /* tell the converter it won't get any more samples */	
+
+		/* everything there is, which makes room for the rest of the input */
+		do {
+			got = fsrc_pull(cvt, &odesc);
+			wrote = fsrc_wave_write(dst, odata, got);
+			if(wrote < got) {
+				printf("write error\n");
+				goto cleanup;
+			}		
+		} while(got == osize);
+
+		if(end && idesc.size == 0) {
 			ret = EXIT_SUCCESS;
 			break;
 		}
-		assert(err == FSRC_S_OK); /* shouldn't be anything else */
-
-		got = fsrc_write(cvt, &odesc);
-		assert(got); /* shouldn't be zero here  */
-
-		wrote = fsrc_wave_write(dst, odata, got);
-		if(wrote < got) {
-			printf("write error\n");
-			break;
-		}		
 	}
 
 	/* call fsrc_reset(cvt) before using the converter object again */
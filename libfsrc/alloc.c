@@ -18,12 +18,20 @@
 
 */
 #include "ifsrc.h"
+#include "thread.h"
 #include <stdlib.h>
 
 #ifdef HAVE_MALLOC_H
 #include <malloc.h>
 #endif
 
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
 #ifndef _WIN64
 
 void *fsrc_alloc(size_t size)
@@ -61,4 +69,244 @@ void fsrc_free(void *p)
 
 #endif
 
+/* no smaller pages around, larger ones just get touched more than once */
+#define FSRC_PAGE 4096
+
+void fsrc_mem_touch(const void *p, size_t size, int write)
+{
+	if(!size)
+		return;
+
+	volatile char *c = (volatile char*)p;
+	for(size_t i = 0; i < size; i += FSRC_PAGE) {
+		if(write)
+			c[i] = c[i];
+		else
+			(void)c[i];
+	}
+	if(write)
+		c[size - 1] = c[size - 1];
+	else
+		(void)c[size - 1];
+}
+
+static int fsrc_os_lock(uintptr_t p, size_t size)
+{
+#ifdef _WIN32
+	return VirtualLock((void*)p, size) ? 0 : -1;
+#else
+	return mlock((void*)p, size);
+#endif
+}
+
+static void fsrc_os_unlock(uintptr_t p, size_t size)
+{
+#ifdef _WIN32
+	VirtualUnlock((void*)p, size);
+#else
+	munlock((void*)p, size);
+#endif
+}
+
+/* the one the os locks by, which FSRC_PAGE may not be */
+static size_t fsrc_os_page(void)
+{
+	static size_t page = 0;
+	if(!page) {
+#ifdef _WIN32
+		SYSTEM_INFO si;
+		GetSystemInfo(&si);
+		page = si.dwPageSize;
+#else
+		long n = sysconf(_SC_PAGESIZE);
+		page = n > 0 ? (size_t)n : FSRC_PAGE;
+#endif
+	}
+	return page;
+}
+
+/* 
+	the os locks don't nest, and converters share pages, with each other 
+	and with the tables. so the locked pages are counted, in a hash of 
+	them under a lock. it's only used by fsrc_prepare and fsrc_destroy
+*/
+typedef struct fsrc_locked_page {
+	struct fsrc_locked_page *next;
+	uintptr_t page;
+	size_t refs;
+} fsrc_locked_page;
+
+#define FSRC_LOCKED_BUCKETS 1024
+
+static fsrc_locked_page *fsrc_locked[FSRC_LOCKED_BUCKETS];
+static fsrc_mutex fsrc_locked_mutex = FSRC_MUTEX_INIT;
+
+static fsrc_locked_page **fsrc_locked_find(uintptr_t page)
+{
+	size_t k = (size_t)((page / fsrc_os_page()) * 0x9e3779b97f4a7c15ull >> 32) % FSRC_LOCKED_BUCKETS;
+	fsrc_locked_page **pp = &fsrc_locked[k];
+	while(*pp && (*pp)->page != page)
+		pp = &(*pp)->next;
+	return pp;
+}
+
+/* drops a count on the pages in [a, b), unlocking the ones no one else has */
+static void fsrc_locked_release(uintptr_t a, uintptr_t b)
+{
+	size_t ps = fsrc_os_page();
+	for(uintptr_t p = a; p < b; p += ps) {
+		fsrc_locked_page **pp = fsrc_locked_find(p);
+		fsrc_locked_page *lp = *pp;
+		if(lp && --lp->refs == 0) {
+			*pp = lp->next;
+			free(lp);
+			fsrc_os_unlock(p, ps);
+		}
+	}
+}
+
+int fsrc_mem_lock(const void *p, size_t size)
+{
+	if(!size)
+		return 0;
+
+	size_t ps = fsrc_os_page();
+	uintptr_t first = (uintptr_t)p & ~(uintptr_t)(ps - 1);
+	uintptr_t end = ((uintptr_t)p + size + ps - 1) & ~(uintptr_t)(ps - 1);
+
+	int ret = 0;
+	fsrc_mutex_lock(&fsrc_locked_mutex);
+
+	uintptr_t a = first;
+	while(a < end && !ret) {
+		fsrc_locked_page *lp = *fsrc_locked_find(a);
+		if(lp) {
+			++lp->refs;
+			a += ps;
+			continue;
+		}
+
+		/* the pages nobody has locked yet, at once */
+		uintptr_t b = a + ps;
+		while(b < end && !*fsrc_locked_find(b))
+			b += ps;
+
+		ret = fsrc_os_lock(a, b - a);
+		for(; !ret && a < b; a += ps) {
+			lp = FSRC_NEW(fsrc_locked_page);
+			if(!lp) {
+				fsrc_os_unlock(a, b - a);
+				ret = -1;
+				break;
+			}
+			fsrc_locked_page **pp = fsrc_locked_find(a);
+			lp->next = *pp;
+			lp->page = a;
+			lp->refs = 1;
+			*pp = lp;
+		}
+	}
 
+	/* let go of what was counted before it failed */
+	if(ret)
+		fsrc_locked_release(first, a);
+
+	fsrc_mutex_unlock(&fsrc_locked_mutex);
+
+	return ret;
+}
+
+void fsrc_mem_unlock(const void *p, size_t size)
+{
+	if(!size)
+		return;
+
+	size_t ps = fsrc_os_page();
+	uintptr_t first = (uintptr_t)p & ~(uintptr_t)(ps - 1);
+	uintptr_t end = ((uintptr_t)p + size + ps - 1) & ~(uintptr_t)(ps - 1);
+
+	fsrc_mutex_lock(&fsrc_locked_mutex);
+	fsrc_locked_release(first, end);
+	fsrc_mutex_unlock(&fsrc_locked_mutex);
+}
+
+static void *fsrc_default_alloc(size_t size, void *arg)
+{
+	(void)arg;
+	return fsrc_alloc(size);
+}
+
+static void fsrc_default_free(void *p, void *arg)
+{
+	(void)arg;
+	fsrc_free(p);
+}
+
+/* cache line aligned pieces, so neighbours don't share one */
+#define FSRC_ARENA_ALIGN 64
+#define FSRC_ARENA_ROUND(n) (((n) + FSRC_ARENA_ALIGN - 1) & ~(size_t)(FSRC_ARENA_ALIGN - 1))
+
+/* alloc only aligns to this much, the arena is moved up to FSRC_ARENA_ALIGN */
+#define FSRC_ALLOC_ALIGN 16
+
+fsrc_heap *fsrc_heap_create(const fsrc_allocator *a, size_t arena)
+{
+	static const fsrc_allocator def = { fsrc_default_alloc, fsrc_default_free, 0 };
+	if(!a)
+		a = &def;
+
+	fsrc_heap *h = (fsrc_heap*)a->alloc(sizeof(fsrc_heap), a->arg);
+	if(!h)
+		return 0;
+
+	h->a = *a;
+	h->block = 0;
+	h->arena = 0;
+	h->size = arena;
+	h->used = 0;
+
+	if(arena) {
+		h->block = a->alloc(arena + FSRC_ARENA_ALIGN - FSRC_ALLOC_ALIGN, a->arg);
+		if(!h->block) {
+			a->free(h, a->arg);
+			return 0;
+		}
+		h->arena = (char*)(((intptr_t)h->block + FSRC_ARENA_ALIGN - 1) & (intptr_t)-FSRC_ARENA_ALIGN);
+	}
+
+	return h;
+}
+
+void fsrc_heap_destroy(fsrc_heap *h)
+{
+	if(h->block)
+		h->a.free(h->block, h->a.arg);
+	h->a.free(h, h->a.arg);
+}
+
+void *fsrc_heap_alloc(fsrc_heap *h, size_t size)
+{
+	size_t n = FSRC_ARENA_ROUND(size);
+	if(!h->arena) {
+		h->used += n;
+		return h->a.alloc(size, h->a.arg);
+	}
+
+	if(h->size - h->used < n)
+		return 0;
+
+	void *p = h->arena + h->used;
+	h->used += n;
+	return p;
+}
+
+void fsrc_heap_free(fsrc_heap *h, void *p)
+{
+	if(p && !h->arena)
+		h->a.free(p, h->a.arg);
+}
+
+size_t fsrc_heap_need(size_t size)
+{
+	return FSRC_ARENA_ROUND(size);
+}
@@ -19,72 +19,373 @@
 */
 #include "ifsrc.h"
 #include "design.h"
+#include "tables.h"
+#include "thread.h"
 #include <stdlib.h>
+#include <stddef.h>
 #include <assert.h>
 #include <string.h>
 #include <stdio.h>
-
-fsrc_err fsrc_file_ioi_create(const char *dir, int mode, const fsrc_ioi ***pvt);
+#include <math.h>
+#include <float.h>
+#include <time.h>
+
+fsrc_err fsrc_file_ioi_create(const char *dir, int mode, const fsrc_ioi ***pvt, const fsrc_ioi_ext **pext);
+
+/*
+	the index is a header and a log of entries, each with a checksum. an 
+	entry only counts once the header's count covers it, and a reader hashes 
+	the committed entries into a table when it first looks at them.
+
+	writers serialize on the lock file. new entries are appended: the data 
+	first, then the entries, then the count, so whatever a committed entry 
+	refers to is already there. once enough of the data file is dead, a 
+	writer compacts the cache instead: the live entries are written to a 
+	new index / data pair which is renamed over the old one.
+
+	with an ioi that can map and rename files, lookups don't lock anything.
+	a reader's mapping is current as long as the index isn't marked stale 
+	and its count hasn't moved. the old index is marked stale before it's 
+	replaced, so a reader that mapped the index, then the data, and still 
+	finds the index current, has a matching pair. the data file is only 
+	ever appended to or replaced, never truncated.
+	without map and rename, everything is done in place under the lock.
+
+	lookups also stamp the entries they find with the time, outside of the 
+	checksum, at most every FSRC_USE_GRANULE seconds. when the cache grows 
+	past its byte budget, a writer compacts it without the entries used 
+	least recently
+*/
 
 struct fsrc_cache {
 	const fsrc_ioi **pioi;
+	fsrc_ioi_ext ext; /* what wasn't given is null */
 	fsrc_iom iom;
 	intptr_t idx;
 	intptr_t dat;
+	intptr_t lck;
+	fsrc_mutex mutex; /* the lock file doesn't keep out other threads */
+	fsrc_cache_view *view; /* guarded by view_mutex */
+	/* so are these */
+	fsrc_ull hits;
+	fsrc_ull misses;
+	double saved;
 };
 
 typedef struct fsrc_cache_hdr {
 	uint32_t tag;
 	uint32_t rev;
+	uint32_t stale; /* set before a new index replaces this one */
+	uint32_t pad;
+	uint64_t count; /* committed entries, anything past them is being written */
+	uint64_t limit; /* byte budget, 0 for none */
 } fsrc_cache_hdr;
 
 #define FSRC_CACHE_TAG 0x66737263
-#define FSRC_CACHE_REV 0
+#define FSRC_CACHE_REV 6
+
+/* what an entry holds */
+enum {
+	FSRC_CACHE_LPF,		/* filter coefficients, keyed by fsrc_lps */
+	FSRC_CACHE_TABLE	/* a stage table, keyed by fsrc_table_key, followed by its filter */
+};
 
-typedef struct lpf_entry {
-	fsrc_lps spec;
+/* how a filter is stored, tables are always stored as they are */
+enum {
+	FSRC_STORE_HALF = 0x01,	/* symmetric, only the first half is kept */
+	FSRC_STORE_F32 = 0x02	/* as floats */
+};
+
+/* unused bytes must be zero, they're checksummed */
+typedef struct fsrc_cache_key {
+	uint32_t kind;
+	uint32_t sub;
+	union {
+		fsrc_lps lps;
+		uint64_t w[6];
+	} u;
+} fsrc_cache_key;
+
+typedef struct cache_entry {
+	fsrc_cache_key key;
+	uint64_t hash;	/* of the quantized key */
 	int64_t off;
-	int64_t n;
-} lpf_entry;
+	int64_t size;	/* in bytes, as stored */
+	uint32_t fmt;	/* FSRC_STORE_* */
+	uint32_t len;	/* filter length */
+	float cost;		/* seconds it took to make */
+	uint32_t pad;
+	uint64_t sum;	/* of all the above */
+	int64_t used;	/* last found, in seconds since the epoch. lookups update it */
+} cache_entry;
 
 typedef struct fsrc_cache_idx {
 	fsrc_cache_hdr hdr;
-	lpf_entry e[1];
+	cache_entry e[1];
 } fsrc_cache_idx;
 
 #define FSRC_CACHE_HDR_SIZE offsetof(fsrc_cache_idx, e)
 
+/* data is aligned like fsrc_alloc does, so it can be used in place */
+#define FSRC_CACHE_ALIGN 64
+
+/* compact once this much of the cache is dead, and it's a quarter of it */
+#define FSRC_COMPACT_MIN (1 << 20)
+
+/* how stale an entry's last use can get before a lookup bothers to update it */
+#define FSRC_USE_GRANULE 600
+
+/* once over its budget, the cache is cut down to this fraction of it, so it doesn't happen all the time */
+#define FSRC_EVICT_NUM 3
+#define FSRC_EVICT_DEN 4
+
+/* 
+	a stored filter is used for a spec it wasn't designed to if it meets it, 
+	and a design to its own spec is estimated to be at most this much longer
+*/
+#define FSRC_LPS_SLACK 1.125
+
+/* 
+	a warm start hint is only used if its length is within this factor of 
+	the new design's estimate. one much further off can keep the first 
+	solve from converging
+*/
+#define FSRC_HINT_LEN 2
+
+/* relative difference between specs put down to rounding */
+#define FSRC_LPS_EPS 1e-9
+
+/* words a key is compared and hashed by */
+#define FSRC_KEY_WORDS 7
+
+#define FSRC_HASH_SEED 0xcbf29ce484222325ull
+#define FSRC_SUM_SEED 0x84222325cbf29ce4ull
+
 typedef struct fsrc_idx_data {
 	size_t n;
 	fsrc_cache_idx *cd;
 } fsrc_idx_data;
 
-#define FSRC_LPS_CMP(a, b) memcmp(a, b, sizeof(fsrc_lps));
+/* open addressing over the committed entries that check out */
+typedef struct fsrc_index {
+	const cache_entry *e;
+	size_t n;		/* committed entries */
+	size_t mask;
+	uint32_t *slot;	/* entry + 1, 0 if free */
+	size_t live;	/* valid entries with distinct keys */
+	uint64_t used;	/* data bytes they take up, padded */
+} fsrc_index;
+
+/* something to store. with no data, it's read from the entry fe of another cache */
+typedef struct fsrc_cache_item {
+	const void *data;
+	size_t size;
+	uint32_t fmt;
+	uint32_t len;
+	double cost;
+	fsrc_cache *from;
+	const cache_entry *fe;
+} fsrc_cache_item;
+
+/* a mapped index / data pair, shared by lookups until it goes stale */
+struct fsrc_cache_view {
+	void (*unmap)(const void *ptr, fsrc_off size); /* the cache may be gone by the time it's unmapped */
+	unsigned refs;
+	const fsrc_cache_idx *ci;
+	fsrc_off isize;
+	fsrc_index ix;
+	const char *dat;
+	fsrc_off dsize;
+};
+
+/* a writer marks the index stale right before renaming, so don't try too hard */
+#define FSRC_VIEW_RETRIES 4
 
 #define LPF_IDX_FILE "lpf.idx"
 #define LPF_DAT_FILE "lpf.dat"
+#define LPF_LCK_FILE "lpf.lck"
+#define LPF_IDX_TEMP "lpf.idx.new"
+#define LPF_DAT_TEMP "lpf.dat.new"
 
-typedef struct merge_result {
-	size_t n;
-	fsrc_cache_idx *cd;
-	size_t m;
-	size_t *I;
-} merge_result;
+static fsrc_mutex view_mutex = FSRC_MUTEX_INIT;
+
+static const char zeros[FSRC_CACHE_ALIGN];
+
+static uint64_t ifsrc_hash(uint64_t x, const uint64_t *w, size_t n)
+{
+	for(size_t i = 0; i < n; ++i) {
+		x = (x ^ w[i]) * 0x100000001b3ull;
+		x ^= x >> 29;
+	}
+	return x;
+}
+
+/* rounds off the low 16 bits of the mantissa, so specs computed slightly differently still match */
+static uint64_t ifsrc_quant(double x)
+{
+	uint64_t w;
+	memcpy(&w, &x, sizeof(w));
+	return (w + 0x8000) & ~(uint64_t)0xffff;
+}
+
+static void ifsrc_key_words(const fsrc_cache_key *key, uint64_t *w)
+{
+	w[0] = key->kind | (uint64_t)key->sub << 32;
+	if(key->kind == FSRC_CACHE_LPF) {
+		const fsrc_lps *lps = &key->u.lps;
+		w[1] = ifsrc_quant(lps->fs);
+		w[2] = ifsrc_quant(lps->fp);
+		w[3] = ifsrc_quant(lps->dp);
+		w[4] = ifsrc_quant(lps->ds);
+		w[5] = lps->flags;
+		w[6] = 0;
+	} else {
+		for(size_t i = 0; i < 6; ++i)
+			w[i + 1] = key->u.w[i];
+	}
+}
+
+static uint64_t ifsrc_key_hash(const fsrc_cache_key *key)
+{
+	uint64_t w[FSRC_KEY_WORDS];
+	ifsrc_key_words(key, w);
+	return ifsrc_hash(FSRC_HASH_SEED, w, FSRC_KEY_WORDS);
+}
+
+static int ifsrc_key_eq(const fsrc_cache_key *a, const fsrc_cache_key *b)
+{
+	uint64_t wa[FSRC_KEY_WORDS], wb[FSRC_KEY_WORDS];
+	ifsrc_key_words(a, wa);
+	ifsrc_key_words(b, wb);
+	return memcmp(wa, wb, sizeof(wa)) == 0;
+}
+
+static uint64_t ifsrc_entry_sum(const cache_entry *e)
+{
+	uint64_t w[offsetof(cache_entry, sum) / sizeof(uint64_t)];
+	memcpy(w, e, sizeof(w));
+	return ifsrc_hash(FSRC_SUM_SEED, w, sizeof(w) / sizeof(w[0]));
+}
+
+/* fills in the hash and checksum, once the rest is final */
+static void ifsrc_entry_seal(cache_entry *e)
+{
+	e->hash = ifsrc_key_hash(&e->key);
+	e->sum = ifsrc_entry_sum(e);
+}
+
+static void ifsrc_lpf_key(fsrc_cache_key *key, const fsrc_lps *lps)
+{
+	memset(key, 0, sizeof(fsrc_cache_key));
+	key->kind = FSRC_CACHE_LPF;
+	key->u.lps = *lps;
+}
+
+static void ifsrc_table_key(fsrc_cache_key *key, const fsrc_table_key *tk)
+{
+	memset(key, 0, sizeof(fsrc_cache_key));
+	key->kind = FSRC_CACHE_TABLE;
+	key->sub = tk->kind;
+	for(size_t i = 0; i < 4; ++i)
+		key->u.w[i] = tk->p[i];
+	key->u.w[4] = tk->n;
+	key->u.w[5] = tk->hash;
+}
+
+/* padding needed to align the next item at off */
+static size_t ifsrc_cache_pad(fsrc_off off)
+{
+	return (size_t)(-off & (FSRC_CACHE_ALIGN - 1));
+}
+
+/* what an entry takes up in the cache, its data's alignment aside */
+static uint64_t ifsrc_entry_bytes(const cache_entry *e)
+{
+	return sizeof(cache_entry) + (uint64_t)e->size + ifsrc_cache_pad(e->size);
+}
+
+/* the slot holding key, or the free one it would go in */
+static size_t ifsrc_index_probe(const fsrc_index *ix, const fsrc_cache_key *key, uint64_t hash)
+{
+	for(size_t j = (size_t)hash & ix->mask;; j = (j + 1) & ix->mask) {
+		uint32_t s = ix->slot[j];
+		if(s == 0)
+			return j;
+		const cache_entry *fe = &ix->e[s - 1];
+		if(fe->hash == hash && ifsrc_key_eq(&fe->key, key))
+			return j;
+	}
+}
+
+static const cache_entry *ifsrc_index_find(const fsrc_index *ix, const fsrc_cache_key *key)
+{
+	uint32_t s = ix->slot[ifsrc_index_probe(ix, key, ifsrc_key_hash(key))];
+	return s ? &ix->e[s - 1] : 0;
+}
+
+/* whether e[i] is what its key finds, and not a torn write or a duplicate */
+static int ifsrc_index_live(const fsrc_index *ix, size_t i)
+{
+	return ifsrc_index_find(ix, &ix->e[i].key) == &ix->e[i];
+}
+
+/* a later entry for the same key replaces the earlier one */
+static fsrc_err ifsrc_index_build(fsrc_index *ix, const cache_entry *e, size_t n)
+{
+	if(n >= UINT32_MAX)
+		return FSRC_E_INVARG;
+
+	size_t m = 16;
+	while(m < 2 * n)
+		m *= 2;
+
+	uint32_t *slot = (uint32_t*)calloc(m, sizeof(uint32_t));
+	if(!slot)
+		return FSRC_E_NOMEM;
+
+	ix->e = e;
+	ix->n = n;
+	ix->mask = m - 1;
+	ix->slot = slot;
+	ix->live = 0;
+	ix->used = 0;
+
+	for(size_t i = 0; i < n; ++i) {
+		if(e[i].sum != ifsrc_entry_sum(&e[i]) || e[i].off < 0 || e[i].size < 0)
+			continue;
+		size_t j = ifsrc_index_probe(ix, &e[i].key, e[i].hash);
+		if(slot[j]) 
+			ix->used -= e[slot[j] - 1].size + ifsrc_cache_pad(e[slot[j] - 1].size);
+		else
+			++ix->live;
+		slot[j] = (uint32_t)(i + 1);
+		ix->used += e[i].size + ifsrc_cache_pad(e[i].size);
+	}
+
+	return FSRC_S_OK;
+}
+
+static void ifsrc_index_free(fsrc_index *ix)
+{
+	free(ix->slot);
+	ix->slot = 0;
+}
 
-static int fsrc_lps_cmp(const void *l, const void *r)
+static int ifsrc_cache_mapped(const fsrc_cache *cache)
 {
-	return FSRC_LPS_CMP(l, r);
+	return cache->ext.map && cache->ext.unmap && cache->ext.rename;
 }
 
 fsrc_err fsrc_cache_create_dir(fsrc_cache **cache, const char *path, int mode, int rw)
 {
 	fsrc_err err;
 	const fsrc_ioi **pioi;
-	err = fsrc_file_ioi_create(path, mode, &pioi);
+	const fsrc_ioi_ext *ext;
+	err = fsrc_file_ioi_create(path, mode, &pioi, &ext);
 	if(err != FSRC_S_OK)
 		return err;
 
-	err = fsrc_cache_create_ioi(cache, pioi, rw);
+	err = fsrc_cache_create_ioi_ex(cache, pioi, ext, rw);
 	if(err != FSRC_S_OK) {
 		(*pioi)->dispose(pioi);
 	}
@@ -92,33 +393,55 @@ fsrc_err fsrc_cache_create_dir(fsrc_cache **cache, const char *path, int mode, i
 	return err;	
 }
 
-static fsrc_err ifsrc_cache_init(fsrc_cache *cache, const fsrc_ioi **pioi, fsrc_iom iom)
+static fsrc_err ifsrc_cache_init(fsrc_cache *cache, const fsrc_ioi **pioi, const fsrc_ioi_ext *ext, fsrc_iom iom)
 {
-	intptr_t idx, dat;
+	intptr_t idx, dat, lck;
 	const fsrc_ioi *ioi = *pioi;
-	fsrc_err err = FSRC_E_EXTERNAL;
-	if(!ioi->open(pioi, &idx, LPF_IDX_FILE, iom)) {
-		if(!ioi->open(pioi, &dat, LPF_DAT_FILE, iom)) {
-			cache->pioi = pioi;
-			cache->iom = iom;
-			cache->idx = idx;
-			cache->dat = dat;
-			return FSRC_S_OK;
+	fsrc_err err = fsrc_mutex_init(&cache->mutex);
+	if(err != FSRC_S_OK)
+		return err;
+
+	err = FSRC_E_EXTERNAL;
+	if(!ioi->open(pioi, &lck, LPF_LCK_FILE, iom)) {
+		if(!ioi->open(pioi, &idx, LPF_IDX_FILE, iom)) {
+			if(!ioi->open(pioi, &dat, LPF_DAT_FILE, iom)) {
+				cache->pioi = pioi;
+				memset(&cache->ext, 0, sizeof(fsrc_ioi_ext));
+				if(ext)
+					memcpy(&cache->ext, ext, MIN(ext->size, sizeof(fsrc_ioi_ext)));
+				cache->iom = iom;
+				cache->idx = idx;
+				cache->dat = dat;
+				cache->lck = lck;
+				cache->view = 0;
+				cache->hits = 0;
+				cache->misses = 0;
+				cache->saved = 0;
+				return FSRC_S_OK;
+			}
+			ioi->close(idx);
 		}
-		ioi->close(idx);
+		ioi->close(lck);
 	}
 
+	fsrc_mutex_destroy(&cache->mutex);
+
 	return err;
 }
 
 fsrc_err fsrc_cache_create_ioi(fsrc_cache **out, const fsrc_ioi **pioi, int rw)
+{
+	return fsrc_cache_create_ioi_ex(out, pioi, 0, rw);
+}
+
+fsrc_err fsrc_cache_create_ioi_ex(fsrc_cache **out, const fsrc_ioi **pioi, const fsrc_ioi_ext *ext, int rw)
 {
 	fsrc_cache *cache = (fsrc_cache*)malloc(sizeof(fsrc_cache));
 	if(!cache)
 		return FSRC_E_NOMEM;
 
 	fsrc_iom iom = rw ? FSRC_IOM_RW : FSRC_IOM_READ;
-	fsrc_err err = ifsrc_cache_init(cache, pioi, iom);
+	fsrc_err err = ifsrc_cache_init(cache, pioi, ext, iom);
 	if(err != FSRC_S_OK) {
 		free(cache);
 		return err;
@@ -129,370 +452,1328 @@ fsrc_err fsrc_cache_create_ioi(fsrc_cache **out, const fsrc_ioi **pioi, int rw)
 	return err;
 }
 
-fsrc_err fsrc_cache_clear(fsrc_cache *cache)
+/* 
+	takes the writer lock. the files may have been replaced since they were 
+	last opened, so open them again
+*/
+static fsrc_err ifsrc_cache_lock(fsrc_cache *cache)
 {
 	const fsrc_ioi *ioi = *cache->pioi;
-	if(ioi->lock(cache->idx))
+	fsrc_mutex_lock(&cache->mutex);
+	if(ioi->lock(cache->lck)) {
+		fsrc_mutex_unlock(&cache->mutex);
 		return FSRC_E_EXTERNAL;
-
-	fsrc_err err = FSRC_S_OK;
-	if(ioi->setsize(cache->idx, 0) || ioi->setsize(cache->dat, 0)) {
-		err = FSRC_E_EXTERNAL;
 	}
 
-	ioi->unlock(cache->idx);
-
-	return err;
-}
-
-void fsrc_cache_destroy(fsrc_cache *cache)
-{
-	const fsrc_ioi *ioi = *cache->pioi;
-	ioi->close(cache->idx);
-	ioi->close(cache->dat);
-	ioi->dispose(cache->pioi);
-	free(cache);
-}
+	if(!ifsrc_cache_mapped(cache))
+		return FSRC_S_OK;
 
-static fsrc_err ifsrc_index_read(fsrc_cache *cache, fsrc_idx_data *ca)
-{	
-	const fsrc_ioi *ioi = *cache->pioi;
-	fsrc_err err = FSRC_S_OK;	
-	fsrc_off off = ioi->getsize(cache->idx);
-	if(off < FSRC_CACHE_HDR_SIZE || off > SIZE_MAX) {
-		err = FSRC_E_INVARG;
-	} else {
-		size_t size = (size_t)off;
-		size_t m = (size - FSRC_CACHE_HDR_SIZE) / sizeof(lpf_entry);
-		size_t r = (size - FSRC_CACHE_HDR_SIZE) % sizeof(lpf_entry);
-		if(r != 0 || m == 0) {
-			err = FSRC_E_INVARG;
-		} else {
-			fsrc_cache_idx *cd = (fsrc_cache_idx*)malloc(size);
-			if(!cd) {
-				err = FSRC_E_NOMEM;
-			} else {
-				if(ioi->seek(cache->idx, 0, SEEK_SET) < 0) {
-					err = FSRC_E_EXTERNAL;					
-				} else if(ioi->read(cache->idx, cd, size) != size) {
-					err = FSRC_E_EXTERNAL;
-				} else if(cd->hdr.tag != FSRC_CACHE_TAG || cd->hdr.rev != FSRC_CACHE_REV) {
-					err = FSRC_E_INVARG;
-				} else {
-					ca->n = m;
-					ca->cd = cd;
-					return FSRC_S_OK;
-				}
-				free(cd);
-			}
+	intptr_t idx, dat;
+	if(!ioi->open(cache->pioi, &idx, LPF_IDX_FILE, cache->iom)) {
+		if(!ioi->open(cache->pioi, &dat, LPF_DAT_FILE, cache->iom)) {
+			ioi->close(cache->idx);
+			ioi->close(cache->dat);
+			cache->idx = idx;
+			cache->dat = dat;
+			return FSRC_S_OK;
 		}
+		ioi->close(idx);
 	}
 
-	return err;
-}
+	ioi->unlock(cache->lck);
+	fsrc_mutex_unlock(&cache->mutex);
 
+	return FSRC_E_EXTERNAL;
+}
 
+static void ifsrc_cache_unlock(fsrc_cache *cache)
+{
+	(*cache->pioi)->unlock(cache->lck);
+	fsrc_mutex_unlock(&cache->mutex);
+}
 
-static fsrc_err ifsrc_index_merge(merge_result *mr, const lpf_entry *a, size_t na, const lpf_entry *b, size_t nb)
+/*
+	replaces the index, and the data file too if dat isn't the current one.
+	without map and rename, the index is simply rewritten in place
+*/
+static fsrc_err ifsrc_cache_publish(fsrc_cache *cache, intptr_t dat, const fsrc_cache_idx *cd, size_t n)
 {
-	size_t size = FSRC_CACHE_HDR_SIZE + sizeof(lpf_entry) * (na + nb);
-	fsrc_cache_idx *cd = (fsrc_cache_idx*)malloc(size);
-	size_t *I = (size_t*)malloc(nb * sizeof(size_t));
-	if(!cd || !I) {
-		free(cd);
-		free(I);
-		return FSRC_E_NOMEM;
+	const fsrc_ioi *ioi = *cache->pioi;
+	size_t size = FSRC_CACHE_HDR_SIZE + sizeof(cache_entry) * n;
+	if(!ifsrc_cache_mapped(cache)) {
+		if(ioi->setsize(cache->idx, 0) || ioi->seek(cache->idx, 0, SEEK_SET) < 0 
+			|| ioi->write(cache->idx, (void*)cd, size) != size || ioi->flush(cache->idx))
+			return FSRC_E_EXTERNAL;
+		return FSRC_S_OK;
 	}
 
-	assert(na != 0 && nb != 0);
+	intptr_t idx;
+	if(ioi->open(cache->pioi, &idx, LPF_IDX_TEMP, FSRC_IOM_RWD))
+		return FSRC_E_EXTERNAL;
 
-	cd->hdr.tag = FSRC_CACHE_TAG;
-	cd->hdr.rev = FSRC_CACHE_REV;
+	if(ioi->write(idx, (void*)cd, size) == size && !ioi->flush(idx)) {
+		/* retire the old pair before anything gets renamed */
+		uint32_t stale = 1;
+		if(ioi->seek(cache->idx, offsetof(fsrc_cache_hdr, stale), SEEK_SET) >= 0) {
+			ioi->write(cache->idx, &stale, sizeof(stale));
+			ioi->flush(cache->idx);
+		}
 
-	lpf_entry *e = cd->e;
-	size_t i = 0;
-	size_t j = 0;
-	size_t k = 0;
-	size_t l = 0;
-	for(;;) {
-		int cmp = FSRC_LPS_CMP(&a[i], &b[j]);
-		if(cmp <= 0) {
-			e[k++] = a[i++];
-			if((cmp == 0 && ++j == nb) || i == na)
-				break;
-		} else {
-			I[l++] = k;
-			e[k++] = b[j++];			
-			if(j == nb)
-				break;
+		if((dat == cache->dat || !cache->ext.rename(cache->pioi, LPF_DAT_TEMP, LPF_DAT_FILE))
+			&& !cache->ext.rename(cache->pioi, LPF_IDX_TEMP, LPF_IDX_FILE)) {
+			ioi->close(cache->idx);
+			cache->idx = idx;
+			if(dat != cache->dat) {
+				ioi->close(cache->dat);
+				cache->dat = dat;
+			}
+			return FSRC_S_OK;
 		}
 	}
 
-	assert(j == nb || i == na);
-	if(i < na) {		
-		do e[k++] = a[i++];
-		while(i < na);
-		assert(j == nb);
-	} else if(j < nb) {
-		do {
-			I[l++] = k;
-			e[k++] = b[j++];			
-		} while(j < nb);
-	}
-	
-	mr->n = k;
-	mr->cd = cd;
-	mr->m = l;
-	mr->I = I;
+	ioi->close(idx);
 
-	return FSRC_S_OK;
+	return FSRC_E_EXTERNAL;
 }
 
-size_t ifsrc_cache_get_lpfs(fsrc_cache *cache, const fsrc_lps *lps, fsrc_lpc *lpc, size_t n)
+/* a copy of the entry's data, read under the lock */
+static void *ifsrc_index_data(fsrc_cache *cache, const cache_entry *fe)
 {
-	if(cache == 0)
+	const fsrc_ioi *ioi = *cache->pioi;
+	if(fe->off < 0 || fe->size <= 0 || (uint64_t)fe->size > SIZE_MAX)
 		return 0;
 
-	const fsrc_ioi *ioi = *cache->pioi;
-	if(ioi->lock(cache->idx))
-		return FSRC_E_EXTERNAL;
+	size_t size = (size_t)fe->size;
+	void *data = fsrc_alloc(size);
+	if(data && ioi->seek(cache->dat, fe->off, SEEK_SET) >= 0 && ioi->read(cache->dat, data, size) == size)
+		return data;
 
-	size_t k = 0;
-	fsrc_idx_data id;
-	fsrc_err err = ifsrc_index_read(cache, &id);
-	if(err == FSRC_S_OK) {	
-		size_t m = id.n;
-		lpf_entry *e = id.cd->e;	
-
-		double *h = 0;
-		for(size_t i = 0; i < n; ++i) {				
-			lpc[i].n = 0;
-			lpc[i].h = 0;
-
-			lpf_entry *fe = (lpf_entry*)
-				bsearch(&lps[i], e, m, sizeof(lpf_entry), fsrc_lps_cmp);
-			if(fe) {
-				size_t size = fe->n * sizeof(double);
-				h = (double*)fsrc_alloc(size);
-				if(!h) {
-					break;
-				} else if(ioi->seek(cache->dat, fe->off, SEEK_SET) < 0) {
-					break;
-				} else if(ioi->read(cache->dat, h, size) != size) {
-					break;
-				} else {
-					lpc[i].n = fe->n;
-					lpc[i].h = h;
-					h = 0;
-					++k;
-				}					
-			}	
-		}
+	fsrc_free(data);
+
+	return 0;
+}
+
+/* writes an item at off, aligned. off is updated to point past it */
+static fsrc_err ifsrc_cache_write_item(const fsrc_ioi *ioi, intptr_t dat, const fsrc_cache_item *it, fsrc_off *off)
+{
+	void *copy = 0;
+	const void *data = it->data;
+	if(!data) {
+		if(!it->from)
+			return FSRC_E_INVARG;
+		data = copy = ifsrc_index_data(it->from, it->fe);
+		if(!data)
+			return FSRC_E_EXTERNAL;
+	}
 
-		free(h);
-		free(id.cd);
+	fsrc_err err = FSRC_E_EXTERNAL;
+	size_t pad = ifsrc_cache_pad(*off);
+	if(ioi->write(dat, (void*)zeros, pad) == pad && ioi->write(dat, (void*)data, it->size) == it->size) {
+		*off += pad + it->size;
+		err = FSRC_S_OK;
 	}
 
-	ioi->unlock(cache->idx);
+	fsrc_free(copy);
 
-	return k;
+	return err;
 }
 
-static fsrc_err ifsrc_cache_write(fsrc_cache *cache, fsrc_cache_idx *ci, fsrc_lpc *lpc, size_t n)
+/* 
+	writes the index from scratch along with the n items it refers to, 
+	the entries' offsets being indices into items
+*/
+static fsrc_err ifsrc_cache_write(fsrc_cache *cache, fsrc_cache_idx *ci, const fsrc_cache_item *items, size_t n, uint64_t limit)
 {
 	const fsrc_ioi *ioi = *cache->pioi;
+	intptr_t dat = cache->dat;
+	if(ifsrc_cache_mapped(cache)) {
+		if(ioi->open(cache->pioi, &dat, LPF_DAT_TEMP, FSRC_IOM_RWD))
+			return FSRC_E_EXTERNAL;
+	} else if(ioi->setsize(dat, 0) || ioi->seek(dat, 0, SEEK_SET) < 0) {
+		return FSRC_E_EXTERNAL;
+	}
+
 	fsrc_err err = FSRC_S_OK;
-	if(ioi->setsize(cache->idx, 0) || ioi->setsize(cache->dat, 0)) {
+	cache_entry *e = ci->e;
+	fsrc_off off = 0;
+
+	for(size_t i = 0; i < n; ++i) {
+		const fsrc_cache_item *it = &items[e[i].off];
+		err = ifsrc_cache_write_item(ioi, dat, it, &off);
+		if(err != FSRC_S_OK)
+			break;
+		e[i].off = off - it->size;
+		ifsrc_entry_seal(&e[i]);
+	}
+
+	if(err == FSRC_S_OK && ioi->flush(dat))
 		err = FSRC_E_EXTERNAL;
-	} else {
-		lpf_entry *e = ci->e;
-		fsrc_off off = 0;
-
-		for(size_t i = 0; i < n; ++i) {
-			size_t j = (size_t)e[i].off;
-			size_t size = lpc[j].n * sizeof(double);
-			if(ioi->write(cache->dat, lpc[j].h, size) != size) {
-				return FSRC_E_EXTERNAL;
-			} 
-
-			e[i].off = off;	
-			off += size;		
-		}
 
-		size_t size = FSRC_CACHE_HDR_SIZE + sizeof(lpf_entry) * n;
-		if(ioi->write(cache->idx, ci, size) != size) {
-			err = FSRC_E_EXTERNAL;
-		}
+	if(err == FSRC_S_OK) {
+		ci->hdr.tag = FSRC_CACHE_TAG;
+		ci->hdr.rev = FSRC_CACHE_REV;
+		ci->hdr.stale = 0;
+		ci->hdr.pad = 0;
+		ci->hdr.count = n;
+		ci->hdr.limit = limit;
+		err = ifsrc_cache_publish(cache, dat, ci, n);
 	}
 
+	if(err != FSRC_S_OK && dat != cache->dat)
+		ioi->close(dat);
+
 	return err;
 }
 
-static fsrc_err ifsrc_cache_append(fsrc_cache *cache, merge_result *mr, fsrc_lpc *lpc, size_t n)
+/* 
+	appends n entries after the count committed ones, with their data. 
+	the offsets are indices into items 
+*/
+static fsrc_err ifsrc_cache_append(fsrc_cache *cache, size_t count, cache_entry *e, const fsrc_cache_item *items, size_t n)
 {
 	const fsrc_ioi *ioi = *cache->pioi;
-	fsrc_err err = FSRC_S_OK;
-	
+
 	fsrc_off off = ioi->seek(cache->dat, 0, SEEK_END);
-	if(off < 0) {
-		err = FSRC_E_EXTERNAL;
-	} else {
-		lpf_entry *e = mr->cd->e;
-
-		for(size_t i = 0; i < mr->m; ++i) {
-			size_t j = mr->I[i];
-			size_t k = (size_t)e[j].off;
-			size_t size = lpc[k].n * sizeof(double);
-			if(ioi->write(cache->dat, lpc[k].h, size) != size) {
-				return FSRC_E_EXTERNAL;
-			} 
-
-			e[j].off = off;	
-			off += size;		
-		}
+	if(off < 0)
+		return FSRC_E_EXTERNAL;
 
-		size_t size = FSRC_CACHE_HDR_SIZE + sizeof(lpf_entry) * mr->n;
-		if(ioi->setsize(cache->idx, 0) || ioi->write(cache->idx, mr->cd, size) != size) {
-			err = FSRC_E_EXTERNAL;
-		}
+	/* the data first, so whatever an entry points to is there by the time it's committed */
+	for(size_t i = 0; i < n; ++i) {
+		const fsrc_cache_item *it = &items[e[i].off];
+		fsrc_err err = ifsrc_cache_write_item(ioi, cache->dat, it, &off);
+		if(err != FSRC_S_OK)
+			return err;
+		e[i].off = off - it->size;
+		ifsrc_entry_seal(&e[i]);
 	}
-	return err;
-}
 
-fsrc_err ifsrc_cache_lpfs(fsrc_cache *cache, const fsrc_lps *lps, fsrc_lpc *lpc, size_t n)
-{
-	if(cache == 0 || cache->iom == FSRC_IOM_READ)
-		return FSRC_E_INVARG;
+	if(ioi->flush(cache->dat))
+		return FSRC_E_EXTERNAL;
 
-	fsrc_cache_idx *ci = (fsrc_cache_idx*)malloc(FSRC_CACHE_HDR_SIZE + n * sizeof(lpf_entry));
-	if(!ci)
-		return FSRC_E_NOMEM;
+	/* then the entries, over whatever a failed writer left past the committed ones */
+	fsrc_off at = FSRC_CACHE_HDR_SIZE + (fsrc_off)(count * sizeof(cache_entry));
+	size_t size = n * sizeof(cache_entry);
+	if(ioi->seek(cache->idx, at, SEEK_SET) != at || ioi->write(cache->idx, e, size) != size || ioi->flush(cache->idx))
+		return FSRC_E_EXTERNAL;
 
-	ci->hdr.tag = FSRC_CACHE_TAG;
-	ci->hdr.rev = FSRC_CACHE_REV;
+	/* and commit them */
+	uint64_t c = count + n;
+	if(ioi->seek(cache->idx, offsetof(fsrc_cache_hdr, count), SEEK_SET) < 0 
+		|| ioi->write(cache->idx, &c, sizeof(c)) != sizeof(c) || ioi->flush(cache->idx))
+		return FSRC_E_EXTERNAL;
 
-	lpf_entry *e = ci->e;
-	for(size_t i = 0; i < n; ++i) {
-		e[i].spec = lps[i];
-		e[i].off = i;
-		e[i].n = lpc[i].n;
-	}
+	return FSRC_S_OK;
+}
 
-	qsort(e, n, sizeof(lpf_entry), fsrc_lps_cmp);
+fsrc_err fsrc_cache_clear(fsrc_cache *cache)
+{
+	fsrc_err err = ifsrc_cache_lock(cache);
+	if(err != FSRC_S_OK)
+		return err;
 
+	/* the budget stays */
+	fsrc_cache_hdr hdr;
 	const fsrc_ioi *ioi = *cache->pioi;
-	fsrc_err err = FSRC_S_OK;
-	if(ioi->lock(cache->idx)) {
-		err = FSRC_E_EXTERNAL;
-	} else {
-		fsrc_idx_data id;
-		err = ifsrc_index_read(cache, &id);
-		if(err != FSRC_S_OK) {
-			err = ifsrc_cache_write(cache, ci, lpc, n);
-		} else {
-			merge_result mr;
-			err = ifsrc_index_merge(&mr, id.cd->e, id.n, ci->e, n);
+	if(ioi->seek(cache->idx, 0, SEEK_SET) < 0 || ioi->read(cache->idx, &hdr, sizeof(hdr)) != sizeof(hdr) 
+		|| hdr.tag != FSRC_CACHE_TAG || hdr.rev != FSRC_CACHE_REV)
+		hdr.limit = 0;
 
-			free(id.cd);
-			free(ci);
-			ci = 0;
-
-			if(err == FSRC_S_OK) {
-				err = ifsrc_cache_append(cache, &mr, lpc, n);				
-				free(mr.cd);
-				free(mr.I);
-			}
-			
-		}
-		ioi->unlock(cache->idx);
-	}
+	fsrc_cache_idx ci;
+	err = ifsrc_cache_write(cache, &ci, 0, 0, hdr.limit);
 
-	free(ci);
+	ifsrc_cache_unlock(cache);
 
 	return err;
 }
 
+static void ifsrc_view_unmap(fsrc_cache_view *v)
+{
+	if(v->ci)
+		v->unmap(v->ci, v->isize);
+	if(v->dat)
+		v->unmap(v->dat, v->dsize);
+	v->ci = 0;
+	v->dat = 0;
+}
+
+static uint64_t ifsrc_view_count(const fsrc_cache_view *v)
+{
+	return ((volatile const fsrc_cache_hdr*)&v->ci->hdr)->count;
+}
 
-static fsrc_err ifsrc_cache_append_dat(fsrc_cache *dst, fsrc_cache *src, merge_result *mr)
+static int ifsrc_view_retired(const fsrc_cache_view *v)
 {
-	const fsrc_ioi *dioi = *dst->pioi;
-	const fsrc_ioi *sioi = *src->pioi;
+	return ((volatile const fsrc_cache_hdr*)&v->ci->hdr)->stale != 0;
+}
 
-	fsrc_err err = FSRC_S_OK;
-	
-	fsrc_off off = dioi->seek(dst->dat, 0, SEEK_END);
-	if(off < 0) {
-		err = FSRC_E_EXTERNAL;
-	} else {
-		void *h = 0;
-		lpf_entry *e = mr->cd->e;
-		for(size_t i = 0; i < mr->m; ++i) {
-			size_t j = mr->I[i];
-			size_t size = (size_t)e[j].n * sizeof(double);
-			h = malloc(size);
-			if(!h) {
-				err = FSRC_E_NOMEM;
-				break;
-			} else if(sioi->seek(src->dat, e[j].off, SEEK_SET) < 0) {
-				err = FSRC_E_EXTERNAL;
-				break;
-			} else if(sioi->read(src->dat, h, size) != size) {
-				err = FSRC_E_EXTERNAL;
+/* replaced, or appended to, since it was mapped */
+static int ifsrc_view_stale(const fsrc_cache_view *v)
+{
+	return ifsrc_view_retired(v) || ifsrc_view_count(v) != v->ix.n;
+}
+
+/* maps the current index and data, null if there's no consistent pair */
+static fsrc_cache_view *ifsrc_view_open(fsrc_cache *cache)
+{
+	const fsrc_ioi **pioi = cache->pioi;
+	const fsrc_ioi *ioi = *pioi;
+	fsrc_cache_view *v = (fsrc_cache_view*)malloc(sizeof(fsrc_cache_view));
+	if(!v)
+		return 0;
+
+	memset(v, 0, sizeof(fsrc_cache_view));
+	v->unmap = cache->ext.unmap;
+	v->refs = 1;
+
+	for(int i = 0; i < FSRC_VIEW_RETRIES; ++i) {
+		intptr_t f;
+		if(ioi->open(pioi, &f, LPF_IDX_FILE, FSRC_IOM_READ))
+			break;
+
+		v->isize = ioi->getsize(f);
+		if(v->isize >= (fsrc_off)FSRC_CACHE_HDR_SIZE)
+			v->ci = (const fsrc_cache_idx*)cache->ext.map(f, v->isize);
+		ioi->close(f);
+
+		if(!v->ci || v->ci->hdr.tag != FSRC_CACHE_TAG || v->ci->hdr.rev != FSRC_CACHE_REV)
+			break;
+
+		/* committed past what got mapped, try again */
+		uint64_t n = ifsrc_view_count(v);
+		if(!ifsrc_view_retired(v) && n <= (uint64_t)(v->isize - FSRC_CACHE_HDR_SIZE) / sizeof(cache_entry)) {
+			if(ioi->open(pioi, &f, LPF_DAT_FILE, FSRC_IOM_READ))
 				break;
-			} else if(dioi->write(dst->dat, h, size) != size) {
-				err = FSRC_E_EXTERNAL;
+
+			v->dsize = ioi->getsize(f);
+			if(v->dsize > 0)
+				v->dat = (const char*)cache->ext.map(f, v->dsize);
+			ioi->close(f);
+
+			if(v->dsize < 0 || (v->dsize > 0 && !v->dat))
 				break;
+
+			if(!ifsrc_view_retired(v)) {
+				if(ifsrc_index_build(&v->ix, v->ci->e, (size_t)n) != FSRC_S_OK)
+					break;
+				return v;
 			}
-			free(h);
-			h = 0;
-			e[j].off = off;	
-			off += size;		
 		}
-		free(h);
-
-		if(err != FSRC_S_OK)
-			return err;
 
-		size_t size = FSRC_CACHE_HDR_SIZE + sizeof(lpf_entry) * mr->n;
-		if(dioi->setsize(dst->idx, 0) || dioi->write(dst->idx, mr->cd, size) != size) {
-			err = FSRC_E_EXTERNAL;
-		}			
+		ifsrc_view_unmap(v);
 	}
-	return err;
+
+	ifsrc_view_unmap(v);
+	free(v);
+
+	return 0;
+}
+
+static void ifsrc_view_unref(fsrc_cache_view *v)
+{
+	if(--v->refs == 0) {
+		ifsrc_view_unmap(v);
+		ifsrc_index_free(&v->ix);
+		free(v);
+	}
+}
+
+/* the current view, remapped if a writer has changed the index since */
+static fsrc_cache_view *ifsrc_cache_view_get(fsrc_cache *cache)
+{
+	fsrc_mutex_lock(&view_mutex);
+
+	fsrc_cache_view *v = cache->view;
+	if(!v || ifsrc_view_stale(v)) {
+		if(v)
+			ifsrc_view_unref(v);
+		v = cache->view = ifsrc_view_open(cache);
+	}
+
+	if(v)
+		++v->refs;
+
+	fsrc_mutex_unlock(&view_mutex);
+
+	return v;
+}
+
+void ifsrc_cache_view_release(fsrc_cache_view *v)
+{
+	if(v) {
+		fsrc_mutex_lock(&view_mutex);
+		ifsrc_view_unref(v);
+		fsrc_mutex_unlock(&view_mutex);
+	}
+}
+
+/* the entry's data, if it's within the mapping */
+static const void *ifsrc_view_data(const fsrc_cache_view *v, const cache_entry *fe)
+{
+	if(fe->off < 0 || fe->size <= 0 || fe->off + fe->size > v->dsize)
+		return 0;
+	return v->dat + fe->off;
+}
+
+void fsrc_cache_destroy(fsrc_cache *cache)
+{
+	const fsrc_ioi *ioi = *cache->pioi;
+	ifsrc_cache_view_release(cache->view);
+	ioi->close(cache->idx);
+	ioi->close(cache->dat);
+	ioi->close(cache->lck);
+	ioi->dispose(cache->pioi);
+	fsrc_mutex_destroy(&cache->mutex);
+	free(cache);
+}
+
+/* reads the header and the committed entries */
+static fsrc_err ifsrc_index_read(fsrc_cache *cache, fsrc_idx_data *ca)
+{	
+	const fsrc_ioi *ioi = *cache->pioi;
+	fsrc_cache_hdr hdr;
+	fsrc_off size = ioi->getsize(cache->idx);
+	if(size < (fsrc_off)FSRC_CACHE_HDR_SIZE)
+		return FSRC_E_INVARG;
+	if(ioi->seek(cache->idx, 0, SEEK_SET) < 0 || ioi->read(cache->idx, &hdr, sizeof(hdr)) != sizeof(hdr))
+		return FSRC_E_EXTERNAL;
+	if(hdr.tag != FSRC_CACHE_TAG || hdr.rev != FSRC_CACHE_REV || hdr.stale)
+		return FSRC_E_INVARG;
+	if(hdr.count > (uint64_t)(size - FSRC_CACHE_HDR_SIZE) / sizeof(cache_entry))
+		return FSRC_E_INVARG;
+
+	size_t n = (size_t)hdr.count;
+	size_t esize = n * sizeof(cache_entry);
+	fsrc_cache_idx *cd = (fsrc_cache_idx*)malloc(FSRC_CACHE_HDR_SIZE + esize);
+	if(!cd)
+		return FSRC_E_NOMEM;
+
+	cd->hdr = hdr;
+	if(ioi->seek(cache->idx, FSRC_CACHE_HDR_SIZE, SEEK_SET) < 0 || ioi->read(cache->idx, cd->e, esize) != esize) {
+		free(cd);
+		return FSRC_E_EXTERNAL;
+	}
+
+	ca->n = n;
+	ca->cd = cd;
+
+	return FSRC_S_OK;
+}
+
+/* a lookup through the mapping when possible, or under the lock otherwise */
+typedef struct fsrc_cache_lookup {
+	fsrc_cache_view *view;
+	fsrc_idx_data id;
+	fsrc_index own;
+	const fsrc_index *ix;
+	int locked;	/* took the lock for it */
+} fsrc_cache_lookup;
+
+/* writers already hold the lock */
+static fsrc_err ifsrc_lookup_begin(fsrc_cache *cache, fsrc_cache_lookup *lu, int locked)
+{
+	lu->view = 0;
+	lu->id.n = 0;
+	lu->id.cd = 0;
+	lu->ix = 0;
+	lu->locked = 0;
+
+	if(ifsrc_cache_mapped(cache)) {
+		lu->view = ifsrc_cache_view_get(cache);
+		if(lu->view) {
+			lu->ix = &lu->view->ix;
+			return FSRC_S_OK;
+		}
+	}
+
+	/* no mapping, fall back to reading under the lock */
+	fsrc_err err = FSRC_S_OK;
+	if(!locked) {
+		err = ifsrc_cache_lock(cache);
+		if(err != FSRC_S_OK)
+			return err;
+		lu->locked = 1;
+	}
+
+	err = ifsrc_index_read(cache, &lu->id);
+	if(err == FSRC_S_OK) {
+		err = ifsrc_index_build(&lu->own, lu->id.cd->e, lu->id.n);
+		if(err == FSRC_S_OK) {
+			lu->ix = &lu->own;
+			return FSRC_S_OK;
+		}
+		free(lu->id.cd);
+	}
+
+	if(lu->locked)
+		ifsrc_cache_unlock(cache);
+
+	return err;
+}
+
+/* 
+	the entry's data. in place if mapped (don't modify it), otherwise a copy 
+	the caller frees with fsrc_free
+*/
+static const void *ifsrc_lookup_data(fsrc_cache *cache, const fsrc_cache_lookup *lu, const cache_entry *fe)
+{
+	if(lu->view)
+		return ifsrc_view_data(lu->view, fe);
+	return ifsrc_index_data(cache, fe);
+}
+
+/* the byte budget. it can be changed in place, so it's read as it is now */
+static uint64_t ifsrc_lookup_limit(const fsrc_cache_lookup *lu)
+{
+	if(lu->view)
+		return ((volatile const fsrc_cache_hdr*)&lu->view->ci->hdr)->limit;
+	return lu->id.cd->hdr.limit;
+}
+
+/* 
+	stamps an entry that was found with the time, unless it was recently 
+	enough. the mapping is read only, so the index is opened to write it.
+	a view's index is still the one under that name if, once it's open, 
+	the view hasn't been retired yet
+*/
+static void ifsrc_lookup_touch(fsrc_cache *cache, const fsrc_cache_lookup *lu, const cache_entry *fe)
+{
+	const fsrc_ioi *ioi = *cache->pioi;
+	int64_t now = (int64_t)time(0);
+	if(cache->iom == FSRC_IOM_READ || (uint64_t)(now - ((volatile const cache_entry*)fe)->used) < FSRC_USE_GRANULE)
+		return;
+
+	fsrc_off at = FSRC_CACHE_HDR_SIZE + (fsrc_off)((fe - lu->ix->e) * sizeof(cache_entry)) + offsetof(cache_entry, used);
+	if(!lu->view) {
+		if(ioi->seek(cache->idx, at, SEEK_SET) >= 0 && ioi->write(cache->idx, &now, sizeof(now)) == sizeof(now))
+			ioi->flush(cache->idx);
+		return;
+	}
+
+	intptr_t f;
+	if(!ioi->open(cache->pioi, &f, LPF_IDX_FILE, FSRC_IOM_RW)) {
+		if(!ifsrc_view_retired(lu->view) && ioi->seek(f, at, SEEK_SET) >= 0)
+			ioi->write(f, &now, sizeof(now));
+		ioi->close(f);
+	}
+}
+
+static void ifsrc_cache_count(fsrc_cache *cache, size_t hits, size_t misses, double saved)
+{
+	fsrc_mutex_lock(&view_mutex);
+	cache->hits += hits;
+	cache->misses += misses;
+	cache->saved += saved;
+	fsrc_mutex_unlock(&view_mutex);
+}
+
+/* keep the view if anything points into it */
+static void ifsrc_lookup_end(fsrc_cache *cache, fsrc_cache_lookup *lu, fsrc_cache_view **keep)
+{
+	if(lu->view) {
+		if(keep)
+			*keep = lu->view;
+		else
+			ifsrc_cache_view_release(lu->view);
+	} else {
+		ifsrc_index_free(&lu->own);
+		free(lu->id.cd);
+		if(lu->locked)
+			ifsrc_cache_unlock(cache);
+	}
+}
+
+/* whether h can be stored as floats, the rounding taking up at most a sixteenth of the ripple allowed */
+static int ifsrc_lpf_floats(const fsrc_lps *lps, const fsrc_lpc *lpc)
+{
+	double s = 0;
+	for(size_t i = 0; i < lpc->n; ++i)
+		s += fabs(lpc->h[i]);
+	return s * (FLT_EPSILON / 2) <= MIN(lps->dp, lps->ds) / 16;
+}
+
+static int ifsrc_lpf_symmetric(const double *h, size_t n)
+{
+	for(size_t i = 0; i < n / 2; ++i) {
+		if(h[i] != h[n - 1 - i])
+			return 0;
+	}
+	return 1;
+}
+
+/* packs a filter for storage. *buf is set if the packed form had to be allocated */
+static fsrc_err ifsrc_lpf_encode(fsrc_cache_item *it, const fsrc_lps *lps, const fsrc_lpc *lpc, int floats, void **buf)
+{
+	size_t n = lpc->n;
+	size_t m = n;
+	uint32_t fmt = 0;
+	if(n > 1 && ifsrc_lpf_symmetric(lpc->h, n)) {
+		fmt |= FSRC_STORE_HALF;
+		m = (n + 1) / 2;
+	}
+	if(floats && ifsrc_lpf_floats(lps, lpc))
+		fmt |= FSRC_STORE_F32;
+
+	*buf = 0;
+	it->fmt = fmt;
+	it->len = (uint32_t)n;
+	it->from = 0;
+	it->data = lpc->h;
+	it->size = m * sizeof(double);
+
+	if(fmt & FSRC_STORE_F32) {
+		float *p = (float*)fsrc_alloc(m * sizeof(float));
+		if(!p)
+			return FSRC_E_NOMEM;
+		for(size_t i = 0; i < m; ++i)
+			p[i] = (float)lpc->h[i];
+		*buf = p;
+		it->data = p;
+		it->size = m * sizeof(float);
+	}
+
+	return FSRC_S_OK;
+}
+
+/* unpacks a stored filter into a new buffer */
+static double *ifsrc_lpf_decode(const cache_entry *fe, const void *data)
+{
+	size_t n = fe->len;
+	size_t m = (fe->fmt & FSRC_STORE_HALF) ? (n + 1) / 2 : n;
+	size_t es = (fe->fmt & FSRC_STORE_F32) ? sizeof(float) : sizeof(double);
+	if(n == 0 || (uint64_t)fe->size != m * es)
+		return 0;
+
+	double *h = (double*)fsrc_alloc(n * sizeof(double));
+	if(!h)
+		return 0;
+
+	if(fe->fmt & FSRC_STORE_F32) {
+		const float *p = (const float*)data;
+		for(size_t i = 0; i < m; ++i)
+			h[i] = p[i];
+	} else {
+		memcpy(h, data, m * sizeof(double));
+	}
+
+	for(size_t i = m; i < n; ++i)
+		h[i] = h[n - 1 - i];
+
+	return h;
+}
+
+/* 
+	the entry's filter. with a mapped view, filters stored as they are 
+	point into it and *shared is set, otherwise it's a copy
+*/
+static double *ifsrc_lookup_lpf(fsrc_cache *cache, const fsrc_cache_lookup *lu, const cache_entry *fe, int *shared)
+{
+	*shared = 0;
+
+	const void *data = ifsrc_lookup_data(cache, lu, fe);
+	if(!data)
+		return 0;
+
+	if(lu->view && fe->fmt == 0 && (uint64_t)fe->size == fe->len * sizeof(double)) {
+		*shared = 1;
+		return (double*)data;
+	}
+
+	double *h = ifsrc_lpf_decode(fe, data);
+	if(!lu->view)
+		fsrc_free((void*)data);
+
+	return h;
+}
+
+/* whether a filter designed to spec b meets spec a, give or take rounding */
+static int ifsrc_lps_meets(const fsrc_lps *b, const fsrc_lps *a)
+{
+	const double e = FSRC_LPS_EPS;
+	return a->flags == b->flags && b->fp >= a->fp * (1 - e) && b->fs <= a->fs * (1 + e) 
+		&& b->dp <= a->dp * (1 + e) && b->ds <= a->ds * (1 + e);
+}
+
+/* the shortest stored filter meeting the spec that isn't needlessly long for it */
+static const cache_entry *ifsrc_lpf_scan(const fsrc_index *ix, const fsrc_lps *lps)
+{
+	double max = FSRC_LPS_SLACK * fsrc_lpf_len(lps->fs - lps->fp, lps->dp, lps->ds);
+	const cache_entry *fe = 0;
+	for(size_t i = 0; i < ix->n; ++i) {
+		const cache_entry *e = &ix->e[i];
+		const fsrc_lps *es = &e->key.u.lps;
+		if(e->key.kind != FSRC_CACHE_LPF || !ifsrc_lps_meets(es, lps) || (fe && e->len >= fe->len))
+			continue;
+		if(fsrc_lpf_len(es->fs - es->fp, es->dp, es->ds) <= max && ifsrc_index_live(ix, i))
+			fe = e;
+	}
+	return fe;
+}
+
+/*
+	looks for each spec's own filter, or failing that, for one designed to 
+	a stricter spec. filters found in a mapped cache, and stored as they 
+	are, point into it. for those shared[i] is set, and *view has to be 
+	released when they're no longer needed. don't free or modify them. 
+	the rest are copies owned by the caller
+*/
+size_t ifsrc_cache_get_lpfs(fsrc_cache *cache, const fsrc_lps *lps, fsrc_lpc *lpc, int *shared, size_t n, fsrc_cache_view **view)
+{
+	*view = 0;
+	for(size_t i = 0; i < n; ++i) {				
+		lpc[i].n = 0;
+		lpc[i].h = 0;
+		shared[i] = 0;
+	}
+
+	if(cache == 0)
+		return 0;
+
+	fsrc_cache_lookup lu;
+	if(ifsrc_lookup_begin(cache, &lu, 0) != FSRC_S_OK) {
+		ifsrc_cache_count(cache, 0, n, 0);
+		return 0;
+	}
+
+	size_t k = 0;
+	int keep = 0;
+	double saved = 0;
+	for(size_t i = 0; i < n; ++i) {
+		fsrc_cache_key key;
+		ifsrc_lpf_key(&key, &lps[i]);
+
+		const cache_entry *fe = ifsrc_index_find(lu.ix, &key);
+		if(!fe)
+			fe = ifsrc_lpf_scan(lu.ix, &lps[i]);
+		if(fe) {
+			double *h = ifsrc_lookup_lpf(cache, &lu, fe, &shared[i]);
+			if(h) {
+				lpc[i].n = fe->len;
+				lpc[i].h = h;
+				keep |= shared[i];
+				saved += fe->cost;
+				ifsrc_lookup_touch(cache, &lu, fe);
+				++k;
+			}
+		}
+	}
+
+	ifsrc_lookup_end(cache, &lu, keep ? view : 0);
+
+	ifsrc_cache_count(cache, k, n - k, saved);
+
+	return k;
+}
+
+/*
+	how far apart two specs are, relative to the transition width and 
+	in decades of ripple. negative if they're too different to be of any use
+*/
+static double fsrc_lps_dist(const fsrc_lps *a, const fsrc_lps *b)
+{
+	if(a->flags != b->flags)
+		return -1;
+
+	double df = a->fs - a->fp;
+	double x[] = {
+		(a->fp - b->fp) / df,
+		(a->fs - b->fs) / df,
+		log10(a->dp / b->dp),
+		log10(a->ds / b->ds)
+	};
+
+	double d = 0;
+	for(size_t i = 0; i < sizeof(x) / sizeof(x[0]); ++i) {
+		if(fabs(x[i]) > 1)
+			return -1;
+		d += x[i] * x[i];
+	}
+
+	return d;
+}
+
+/* 
+	finds the closest design to start a new one from, and how far off the 
+	length estimate was for cached designs with similar stopbands
+*/
+static const cache_entry *ifsrc_hint_scan(const fsrc_index *ix, const fsrc_lps *lps, double *kn)
+{
+	const cache_entry *e = ix->e;
+	const cache_entry *fe = 0;	
+	double dmin = 0;
+	double skn = 0;
+	size_t nkn = 0;
+	double est = fsrc_lpf_len(lps->fs - lps->fp, lps->dp, lps->ds);
+	for(size_t i = 0; i < ix->n; ++i) {
+		if(e[i].key.kind != FSRC_CACHE_LPF)
+			continue;
+
+		const fsrc_lps *es = &e[i].key.u.lps;
+		if(es->flags != lps->flags || !ifsrc_index_live(ix, i))
+			continue;
+
+		/* within 10dB of stopband attenuation */
+		if(fabs(log10(es->ds / lps->ds)) <= 0.5) {
+			double en = (double)e[i].len;
+			skn += log(en / fsrc_lpf_len(es->fs - es->fp, es->dp, es->ds));
+			++nkn;
+		}
+
+		/* see FSRC_HINT_LEN */
+		double kl = e[i].len / est;
+		if(kl * FSRC_HINT_LEN < 1 || kl > FSRC_HINT_LEN)
+			continue;
+
+		double d = fsrc_lps_dist(lps, es);
+		if(d >= 0 && (!fe || d < dmin)) {
+			fe = &e[i];
+			dmin = d;
+		}
+	}
+
+	*kn = nkn ? exp(skn / nkn) : 0;
+
+	/* minimum phase designs are no good as a starting point */
+	if(lps->flags & FSRC_LPF_MINPHASE)
+		fe = 0;
+
+	return fe;
+}
+
+/* warm start data for a new design. the returned filter is a copy */
+size_t ifsrc_cache_get_hint(fsrc_cache *cache, const fsrc_lps *lps, fsrc_lpf_hint *hint)
+{
+	hint->lpc.n = 0;
+	hint->lpc.h = 0;
+	hint->kn = 0;
+
+	fsrc_cache_lookup lu;
+	if(cache == 0 || ifsrc_lookup_begin(cache, &lu, 0) != FSRC_S_OK)
+		return 0;
+
+	size_t k = 0;
+	const cache_entry *fe = ifsrc_hint_scan(lu.ix, lps, &hint->kn);
+	if(fe) {
+		int shared;
+		double *h = ifsrc_lookup_lpf(cache, &lu, fe, &shared);
+		if(h && shared) {
+			void *c = fsrc_alloc(fe->len * sizeof(double));
+			if(c)
+				memcpy(c, h, fe->len * sizeof(double));
+			h = (double*)c;
+		}
+		if(h) {
+			hint->lpc.n = fe->len;
+			hint->lpc.h = h;
+			k = 1;
+		}
+	}
+
+	ifsrc_lookup_end(cache, &lu, 0);
+
+	return k;
+}
+
+/* whether the table in data was made from the key's filter, stored after it */
+static int ifsrc_table_from(const cache_entry *fe, const void *data, const fsrc_table_key *tk, size_t size)
+{
+	size_t hsize = tk->n * sizeof(double);
+	return fe->len == tk->n && fe->size == (int64_t)(size + hsize) 
+		&& memcmp((const char*)data + size, tk->h, hsize) == 0;
+}
+
+/* 
+	finds a stage table. in place, with *view to be released, if mapped.
+	otherwise *data is a copy owned by the caller
+*/
+fsrc_err ifsrc_cache_get_table(fsrc_cache *cache, const fsrc_table_key *tk, size_t size, const void **data, fsrc_cache_view **view)
+{
+	*data = 0;
+	*view = 0;
+
+	fsrc_cache_lookup lu;
+	fsrc_err err = ifsrc_lookup_begin(cache, &lu, 0);
+	if(err != FSRC_S_OK) {
+		ifsrc_cache_count(cache, 0, 1, 0);
+		return err;
+	}
+
+	fsrc_cache_key key;
+	ifsrc_table_key(&key, tk);
+
+	double saved = 0;
+	const cache_entry *fe = ifsrc_index_find(lu.ix, &key);
+	if(fe && fe->fmt == 0 && fe->size == (int64_t)(size + tk->n * sizeof(double)))
+		*data = ifsrc_lookup_data(cache, &lu, fe);
+	/* the key only has the filter's hash */
+	if(*data && !ifsrc_table_from(fe, *data, tk, size)) {
+		if(!lu.view)
+			fsrc_free((void*)*data);
+		*data = 0;
+	}
+	if(*data) {
+		saved = fe->cost;
+		ifsrc_lookup_touch(cache, &lu, fe);
+	}
+
+	ifsrc_lookup_end(cache, &lu, *data ? view : 0);
+
+	ifsrc_cache_count(cache, *data != 0, *data == 0, saved);
+
+	return *data ? FSRC_S_OK : FSRC_E_INVARG;
+}
+
+/* dead data and entries (torn, replaced, pointing nowhere) worth reclaiming */
+static int ifsrc_compact_due(fsrc_cache *cache, const fsrc_index *ix)
+{
+	fsrc_off dsize = (*cache->pioi)->getsize(cache->dat);
+	if(dsize < 0)
+		return 0;
+
+	uint64_t total = (uint64_t)dsize + ix->n * sizeof(cache_entry);
+	uint64_t used = ix->used + ix->live * sizeof(cache_entry);
+	uint64_t dead = total > used ? total - used : 0;
+
+	return dead >= FSRC_COMPACT_MIN && dead * 4 >= total;
+}
+
+/* whether the cache, with the n new entries appended, goes over limit */
+static int ifsrc_cache_over(fsrc_cache *cache, const fsrc_index *ix, const cache_entry *ne, size_t n, uint64_t limit)
+{
+	fsrc_off dsize = (*cache->pioi)->getsize(cache->dat);
+	if(limit == 0 || dsize < 0)
+		return 0;
+
+	uint64_t total = FSRC_CACHE_HDR_SIZE + (uint64_t)dsize + ix->n * sizeof(cache_entry);
+	for(size_t i = 0; i < n; ++i)
+		total += ifsrc_entry_bytes(&ne[i]);
+
+	return total > limit;
+}
+
+typedef struct fsrc_cache_lru {
+	int64_t used;
+	size_t i;
+} fsrc_cache_lru;
+
+static int fsrc_cache_lru_cmp(const void *l, const void *r)
+{
+	const fsrc_cache_lru *a = (const fsrc_cache_lru*)l;
+	const fsrc_cache_lru *b = (const fsrc_cache_lru*)r;
+	if(a->used != b->used)
+		return a->used < b->used ? -1 : 1;
+	return a->i < b->i ? -1 : a->i > b->i;
+}
+
+/*
+	if the m live entries le and the n new ones don't fit in limit, drops 
+	the live ones used least recently until it's all down to a fraction 
+	of it. the new ones always stay. le keeps its order, returns how many 
+	are left in it
+*/
+static size_t ifsrc_cache_evict(const cache_entry **le, size_t m, const cache_entry *ne, size_t n, uint64_t limit)
+{
+	uint64_t total = FSRC_CACHE_HDR_SIZE;
+	for(size_t i = 0; i < m; ++i)
+		total += ifsrc_entry_bytes(le[i]);
+	for(size_t i = 0; i < n; ++i)
+		total += ifsrc_entry_bytes(&ne[i]);
+
+	if(limit == 0 || total <= limit || m == 0)
+		return m;
+
+	/* lookups keep stamping them, so sort a snapshot */
+	fsrc_cache_lru *lru = FSRC_ARRAY(fsrc_cache_lru, m);
+	if(!lru)
+		return m;
+
+	for(size_t i = 0; i < m; ++i) {
+		lru[i].used = ((volatile const cache_entry*)le[i])->used;
+		lru[i].i = i;
+	}
+
+	qsort(lru, m, sizeof(fsrc_cache_lru), fsrc_cache_lru_cmp);
+
+	uint64_t target = limit / FSRC_EVICT_DEN * FSRC_EVICT_NUM;
+	for(size_t j = 0; j < m && total > target; ++j) {
+		total -= ifsrc_entry_bytes(le[lru[j].i]);
+		le[lru[j].i] = 0;
+	}
+
+	free(lru);
+
+	size_t k = 0;
+	for(size_t i = 0; i < m; ++i) {
+		if(le[i])
+			le[k++] = le[i];
+	}
+
+	return k;
+}
+
+/*
+	writes whatever's live in lu, followed by the n new entries, to a new 
+	index and data file, evicting old entries to stay within limit. the 
+	new entries' offsets are indices into items
+*/
+static fsrc_err ifsrc_cache_rewrite(fsrc_cache *cache, const fsrc_cache_lookup *lu, const cache_entry *ne, const fsrc_cache_item *items, size_t n, uint64_t limit)
+{
+	size_t m = lu ? lu->ix->live : 0;
+	fsrc_cache_idx *ci = (fsrc_cache_idx*)malloc(FSRC_CACHE_HDR_SIZE + (m + n + 1) * sizeof(cache_entry));
+	fsrc_cache_item *it = (fsrc_cache_item*)malloc((m + n + 1) * sizeof(fsrc_cache_item));
+	const cache_entry **le = (const cache_entry**)malloc((m + 1) * sizeof(cache_entry*));
+	if(!ci || !it || !le) {
+		free(ci);
+		free(it);
+		free(le);
+		return FSRC_E_NOMEM;
+	}
+
+	m = 0;
+	for(size_t i = 0; lu && i < lu->ix->n; ++i) {
+		if(ifsrc_index_live(lu->ix, i))
+			le[m++] = &lu->ix->e[i];
+	}
+
+	m = ifsrc_cache_evict(le, m, ne, n, limit);
+
+	fsrc_err err = FSRC_S_OK;
+	cache_entry *e = ci->e;
+	size_t k = 0;
+	for(size_t i = 0; i < m; ++i) {
+		/* without a mapping, the old data goes away before the new is written */
+		const cache_entry *fe = le[i];
+		it[k].data = ifsrc_lookup_data(cache, lu, fe);
+		it[k].size = (size_t)fe->size;
+		it[k].from = 0;
+		if(!it[k].data)
+			continue;
+
+		e[k] = *fe;
+		e[k].off = k;
+		++k;
+	}
+
+	for(size_t i = 0; i < n; ++i) {
+		it[k] = items[ne[i].off];
+		e[k] = ne[i];
+		e[k].off = k;
+		++k;
+	}
+
+	err = ifsrc_cache_write(cache, ci, it, k, limit);
+
+	if(lu && !lu->view) {
+		for(size_t i = 0; i < k - n; ++i)
+			fsrc_free((void*)it[i].data);
+	}
+
+	free(le);
+	free(it);
+	free(ci);
+
+	return err;
+}
+
+/* 
+	stores the n entries e that lu doesn't have yet, appending them or 
+	compacting everything if it's time or they wouldn't fit. without lu, 
+	starts over
+*/
+static fsrc_err ifsrc_cache_store(fsrc_cache *cache, const fsrc_cache_lookup *lu, cache_entry *e, const fsrc_cache_item *items, size_t n)
+{
+	if(!lu)
+		return ifsrc_cache_rewrite(cache, 0, e, items, n, 0);
+
+	size_t m = 0;
+	for(size_t i = 0; i < n; ++i) {
+		int dup = ifsrc_index_find(lu->ix, &e[i].key) != 0;
+		for(size_t j = 0; j < m && !dup; ++j)
+			dup = ifsrc_key_eq(&e[j].key, &e[i].key);
+		if(!dup)
+			e[m++] = e[i];
+	}
+
+	if(m == 0)
+		return FSRC_S_OK;
+
+	uint64_t limit = ifsrc_lookup_limit(lu);
+	if(ifsrc_compact_due(cache, lu->ix) || ifsrc_cache_over(cache, lu->ix, e, m, limit))
+		return ifsrc_cache_rewrite(cache, lu, e, items, m, limit);
+
+	return ifsrc_cache_append(cache, lu->ix->n, e, items, m);
+}
+
+/* stores n items under the given keys, skipping the ones already there */
+static fsrc_err ifsrc_cache_put(fsrc_cache *cache, const fsrc_cache_key *keys, const fsrc_cache_item *items, size_t n)
+{
+	if(cache == 0 || cache->iom == FSRC_IOM_READ)
+		return FSRC_E_INVARG;
+
+	cache_entry *e = (cache_entry*)malloc(n * sizeof(cache_entry));
+	if(!e)
+		return FSRC_E_NOMEM;
+
+	for(size_t i = 0; i < n; ++i) {
+		e[i].key = keys[i];
+		e[i].hash = ifsrc_key_hash(&keys[i]);
+		e[i].off = i;
+		e[i].size = items[i].size;
+		e[i].fmt = items[i].fmt;
+		e[i].len = items[i].len;
+		e[i].cost = (float)items[i].cost;
+		e[i].pad = 0;
+		e[i].sum = 0;
+		e[i].used = (int64_t)time(0);
+	}
+
+	fsrc_err err = ifsrc_cache_lock(cache);
+	if(err == FSRC_S_OK) {
+		fsrc_cache_lookup lu;
+		if(ifsrc_lookup_begin(cache, &lu, 1) != FSRC_S_OK) {
+			/* nothing usable there */
+			err = ifsrc_cache_store(cache, 0, e, items, n);
+		} else {
+			err = ifsrc_cache_store(cache, &lu, e, items, n);
+			ifsrc_lookup_end(cache, &lu, 0);
+		}
+		ifsrc_cache_unlock(cache);
+	}
+
+	free(e);
+
+	return err;
+}
+
+/* 
+	filters with floats[i] set are stored as floats where the spec allows. 
+	cost is how long each took to design. both are optional
+*/
+fsrc_err ifsrc_cache_lpfs(fsrc_cache *cache, const fsrc_lps *lps, const fsrc_lpc *lpc, const int *floats, const double *cost, size_t n)
+{
+	if(n == 0)
+		return FSRC_S_OK;
+
+	fsrc_cache_key *keys = FSRC_ARRAY(fsrc_cache_key, n);
+	fsrc_cache_item *items = FSRC_ARRAY(fsrc_cache_item, n);
+	void **buf = FSRC_ARRAY(void*, n);
+
+	fsrc_err err = FSRC_E_NOMEM;
+	size_t m = 0;
+	if(keys && items && buf) {
+		err = FSRC_S_OK;
+		for(; m < n && err == FSRC_S_OK; ++m) {
+			ifsrc_lpf_key(&keys[m], &lps[m]);
+			err = ifsrc_lpf_encode(&items[m], &lps[m], &lpc[m], floats && floats[m], &buf[m]);
+			items[m].cost = cost ? cost[m] : 0;
+		}
+
+		if(err == FSRC_S_OK)
+			err = ifsrc_cache_put(cache, keys, items, n);
+	}
+
+	for(size_t i = 0; i < m; ++i)
+		fsrc_free(buf[i]);
+
+	free(keys);
+	free(items);
+	free(buf);
+
+	return err;
+}
+
+fsrc_err ifsrc_cache_put_table(fsrc_cache *cache, const fsrc_table_key *tk, const void *data, size_t size, double cost)
+{
+	fsrc_cache_key key;
+	ifsrc_table_key(&key, tk);
+
+	/* the filter goes with it, to tell it apart from others with the same hash */
+	size_t hsize = tk->n * sizeof(double);
+	char *buf = (char*)malloc(size + hsize);
+	if(!buf)
+		return FSRC_E_NOMEM;
+	memcpy(buf, data, size);
+	memcpy(buf + size, tk->h, hsize);
+
+	fsrc_cache_item item;
+	item.data = buf;
+	item.size = size + hsize;
+	item.fmt = 0;
+	item.len = (uint32_t)tk->n;
+	item.cost = cost;
+	item.from = 0;
+
+	fsrc_err err = ifsrc_cache_put(cache, &key, &item, 1);
+
+	free(buf);
+
+	return err;
+}
+
+fsrc_err fsrc_cache_compact(fsrc_cache *cache)
+{
+	if(cache->iom == FSRC_IOM_READ)
+		return FSRC_E_INVARG;
+
+	fsrc_err err = ifsrc_cache_lock(cache);
+	if(err != FSRC_S_OK)
+		return err;
+
+	fsrc_cache_lookup lu;
+	err = ifsrc_lookup_begin(cache, &lu, 1);
+	if(err == FSRC_S_OK) {
+		err = ifsrc_cache_rewrite(cache, &lu, 0, 0, 0, ifsrc_lookup_limit(&lu));
+		ifsrc_lookup_end(cache, &lu, 0);
+	}
+
+	ifsrc_cache_unlock(cache);
+
+	return err;
+}
+
+/* 
+	two caches on the same directory. the locks would be on the same file, 
+	and releasing one releases both, or waits on itself
+*/
+static int ifsrc_cache_same(const fsrc_cache *a, const fsrc_cache *b)
+{
+	return a->ext.same && a->ext.same == b->ext.same && a->ext.same(a->lck, b->lck);
 }
 
 fsrc_err fsrc_cache_import(fsrc_cache *dst, fsrc_cache *src)
 {
-	const fsrc_ioi *dioi = *dst->pioi;
-	const fsrc_ioi *sioi = *src->pioi;
+	if(dst == src || ifsrc_cache_same(dst, src))
+		return FSRC_S_OK;
+
+	/* 
+		src is only locked while it's read, and dst after that. holding 
+		both could deadlock with an import the other way. what's read 
+		from a mapping stays mapped until it's been stored, the rest is 
+		copied out
+	*/
+	fsrc_cache_lookup sl;
+	fsrc_err err = ifsrc_lookup_begin(src, &sl, 0);
+	if(err != FSRC_S_OK)
+		return err;
 
-	fsrc_err err = FSRC_E_EXTERNAL;
-	if(!dioi->lock(dst->idx)) {
-		if(!sioi->lock(src->idx)) {
-			fsrc_idx_data did;
-			err = ifsrc_index_read(dst, &did);
-			if(err == FSRC_S_OK) {
-				fsrc_idx_data sid;
-				err = ifsrc_index_read(src, &sid);
-				if(err == FSRC_S_OK) {
-					merge_result mr;
-					err = ifsrc_index_merge(&mr, did.cd->e, did.n, sid.cd->e, sid.n);
-					if(err == FSRC_S_OK) {
-						free(sid.cd);
-						free(did.cd);
-						did.cd = sid.cd = 0;						
-						err = ifsrc_cache_append_dat(dst, src, &mr);
-						free(mr.cd);
-						free(mr.I);
-					}
-					free(sid.cd);
+	size_t n = sl.ix->live;
+	cache_entry *e = (cache_entry*)malloc((n + 1) * sizeof(cache_entry));
+	fsrc_cache_item *it = (fsrc_cache_item*)malloc((n + 1) * sizeof(fsrc_cache_item));
+	void **copies = (void**)calloc(n + 1, sizeof(void*));
+	size_t k = 0;
+	if(!e || !it || !copies) {
+		err = FSRC_E_NOMEM;
+	} else {
+		for(size_t i = 0; i < sl.ix->n && err == FSRC_S_OK; ++i) {
+			if(!ifsrc_index_live(sl.ix, i))
+				continue;
+			const cache_entry *fe = &sl.ix->e[i];
+			if(sl.view) {
+				it[k].data = ifsrc_view_data(sl.view, fe);
+				if(!it[k].data)
+					continue;
+			} else {
+				it[k].data = copies[k] = ifsrc_index_data(src, fe);
+				if(!it[k].data) {
+					err = FSRC_E_EXTERNAL;
+					break;
 				}
-				free(did.cd);
 			}
-			sioi->unlock(src->idx);
+			it[k].size = (size_t)fe->size;
+			it[k].from = 0;
+			it[k].fe = 0;
+			e[k] = *fe;
+			e[k].off = k;
+			++k;
 		}
-		dioi->unlock(dst->idx);
 	}
+
+	fsrc_cache_view *view = 0;
+	ifsrc_lookup_end(src, &sl, &view);
+
+	if(err == FSRC_S_OK)
+		err = ifsrc_cache_lock(dst);
+	if(err == FSRC_S_OK) {
+		fsrc_cache_lookup dl;
+		if(ifsrc_lookup_begin(dst, &dl, 1) != FSRC_S_OK) {
+			err = ifsrc_cache_store(dst, 0, e, it, k);
+		} else {
+			err = ifsrc_cache_store(dst, &dl, e, it, k);
+			ifsrc_lookup_end(dst, &dl, 0);
+		}
+		ifsrc_cache_unlock(dst);
+	}
+
+	if(view)
+		ifsrc_cache_view_release(view);
+	for(size_t i = 0; copies && i < k; ++i)
+		fsrc_free(copies[i]);
+	free(copies);
+	free(e);
+	free(it);
+
 	return err;
 }
 
+fsrc_err fsrc_cache_set_limit(fsrc_cache *cache, fsrc_ull bytes)
+{
+	if(cache->iom == FSRC_IOM_READ)
+		return FSRC_E_INVARG;
+
+	fsrc_err err = ifsrc_cache_lock(cache);
+	if(err != FSRC_S_OK)
+		return err;
+
+	const fsrc_ioi *ioi = *cache->pioi;
+	uint64_t limit = bytes;
+	fsrc_cache_lookup lu;
+	if(ifsrc_lookup_begin(cache, &lu, 1) != FSRC_S_OK) {
+		/* nothing usable there */
+		fsrc_cache_idx ci;
+		err = ifsrc_cache_write(cache, &ci, 0, 0, limit);
+	} else {
+		if(ifsrc_cache_over(cache, lu.ix, 0, 0, limit)) {
+			err = ifsrc_cache_rewrite(cache, &lu, 0, 0, 0, limit);
+		} else if(ioi->seek(cache->idx, offsetof(fsrc_cache_hdr, limit), SEEK_SET) < 0 
+			|| ioi->write(cache->idx, &limit, sizeof(limit)) != sizeof(limit) || ioi->flush(cache->idx)) {
+			err = FSRC_E_EXTERNAL;
+		}
+		ifsrc_lookup_end(cache, &lu, 0);
+	}
+
+	ifsrc_cache_unlock(cache);
+
+	return err;
+}
+
+fsrc_err fsrc_cache_stats(fsrc_cache *cache, fsrc_stats *stats)
+{
+	const fsrc_ioi *ioi = *cache->pioi;
+	memset(stats, 0, sizeof(fsrc_stats));
+
+	fsrc_mutex_lock(&view_mutex);
+	stats->hits = cache->hits;
+	stats->misses = cache->misses;
+	stats->saved = cache->saved;
+	fsrc_mutex_unlock(&view_mutex);
+
+	fsrc_cache_lookup lu;
+	fsrc_err err = ifsrc_lookup_begin(cache, &lu, 0);
+	if(err != FSRC_S_OK)
+		return err;
+
+	stats->entries = lu.ix->live;
+	stats->live = lu.ix->used + lu.ix->live * sizeof(cache_entry) + FSRC_CACHE_HDR_SIZE;
+	stats->limit = ifsrc_lookup_limit(&lu);
+	if(lu.view) {
+		stats->bytes = (fsrc_ull)(lu.view->isize + lu.view->dsize);
+	} else {
+		fsrc_off isize = ioi->getsize(cache->idx);
+		fsrc_off dsize = ioi->getsize(cache->dat);
+		if(isize > 0 && dsize >= 0)
+			stats->bytes = (fsrc_ull)(isize + dsize);
+	}
+
+	ifsrc_lookup_end(cache, &lu, 0);
+
+	return FSRC_S_OK;
+}
@@ -21,6 +21,8 @@
 #include "design.h"
 #include "stage.h"
 #include "formats.h"
+#include "thread.h"
+#include "tables.h"
 #include <string.h>
 #include <stdlib.h>
 #include <assert.h>
@@ -33,6 +35,8 @@ static const size_t sample_size[] = {
 	8, /* fsrc_f64, */
 };
 
+typedef struct fsrc_async fsrc_async;
+
 struct fsrc_converter
 {
 	fsrc_ratio ratio;
@@ -43,46 +47,158 @@ struct fsrc_converter
 	int eos;
 	size_t rem;
 
-	fsrc_iobuf bufs[FSRC_MAX_STAGES + 1];
+	size_t opos; /* where fsrc_write goes on from in the output buffer */
+
+	fsrc_input_proc iproc; /* see fsrc_set_input */
+	void *iarg;
+
+	fsrc_iobuf *bufs; /* nstages + 1, apart so the stages' pointers survive a swap */
 	fsrc_stage *stages[FSRC_MAX_STAGES];
 
 	fsrc_cvt_tbl_t icvt;
 	fsrc_cvt_tbl_t ocvt;
 
 	size_t ss;
+
+	int locked; /* see fsrc_prepare */
+
+	fsrc_heap *heap; /* see fsrc_create_ex */
+
+	fsrc_async *async; /* the final design, while it's not in use yet */
 };
 
-fsrc_err dols_create(const fsrc_stage_model *ms, fsrc_stage **s, fsrc_iobuf *src, fsrc_iobuf *dst, size_t chans);
-fsrc_err sols_create(const fsrc_stage_model *ms, fsrc_stage **s, fsrc_iobuf *src, fsrc_iobuf *dst, size_t chans);
-fsrc_err dpps_create(const fsrc_stage_model *ms, fsrc_stage **s, fsrc_iobuf *src, fsrc_iobuf *dst, size_t chans);
-fsrc_err spps_create(const fsrc_stage_model *ms, fsrc_stage **s, fsrc_iobuf *src, fsrc_iobuf *dst, size_t chans);
+/* a design being finished in the background, see fsrc_create_async */
+struct fsrc_async {
+	fsrc_thread thread;
+	fsrc_mutex mutex;
+	int done;				/* next and err are set, read under the mutex */
+	int taken;				/* the result was swapped in, or not. only the converter's user touches it */
+	fsrc_converter *next;	/* what fsrc_process swaps in */
+	fsrc_converter *old;	/* what it swapped out, freed outside of fsrc_process */
+	fsrc_err err;
+
+	fsrc_converter *src;
+	fsrc_cache *cache;
+	fsrc_spec spec;
+	size_t lens[FSRC_MAX_STAGES];	/* the stand-ins' filter lengths */
+	int sums[FSRC_MAX_STAGES];		/* and their FSRC_WIDE_SUMS */
+	int prep;						/* fsrc_prepare was called, with pflags */
+	int pflags;
+	fsrc_async_proc proc;
+	void *arg;
+};
 
-typedef fsrc_err (*fsrc_stage_ctor)(const fsrc_stage_model *, fsrc_stage **, fsrc_iobuf *, fsrc_iobuf *, size_t);
+fsrc_err dols_create(const fsrc_stage_model *ms, fsrc_stage **s, fsrc_iobuf *src, fsrc_iobuf *dst, size_t chans, fsrc_heap *heap);
+fsrc_err sols_create(const fsrc_stage_model *ms, fsrc_stage **s, fsrc_iobuf *src, fsrc_iobuf *dst, size_t chans, fsrc_heap *heap);
+fsrc_err dpps_create(const fsrc_stage_model *ms, fsrc_stage **s, fsrc_iobuf *src, fsrc_iobuf *dst, size_t chans, fsrc_heap *heap);
+fsrc_err spps_create(const fsrc_stage_model *ms, fsrc_stage **s, fsrc_iobuf *src, fsrc_iobuf *dst, size_t chans, fsrc_heap *heap);
+fsrc_err wpps_create(const fsrc_stage_model *ms, fsrc_stage **s, fsrc_iobuf *src, fsrc_iobuf *dst, size_t chans, fsrc_heap *heap);
+fsrc_err lpps_create(const fsrc_stage_model *ms, fsrc_stage **s, fsrc_iobuf *src, fsrc_iobuf *dst, size_t chans, fsrc_heap *heap);
+fsrc_err dhbs_create(const fsrc_stage_model *ms, fsrc_stage **s, fsrc_iobuf *src, fsrc_iobuf *dst, size_t chans, fsrc_heap *heap);
+fsrc_err shbs_create(const fsrc_stage_model *ms, fsrc_stage **s, fsrc_iobuf *src, fsrc_iobuf *dst, size_t chans, fsrc_heap *heap);
+fsrc_err mpps_create(const fsrc_stage_model *ms, fsrc_stage **s, fsrc_iobuf *src, fsrc_iobuf *dst, size_t chans, fsrc_heap *heap);
+fsrc_err mhbs_create(const fsrc_stage_model *ms, fsrc_stage **s, fsrc_iobuf *src, fsrc_iobuf *dst, size_t chans, fsrc_heap *heap);
+
+typedef fsrc_err (*fsrc_stage_ctor)(const fsrc_stage_model *, fsrc_stage **, fsrc_iobuf *, fsrc_iobuf *, size_t, fsrc_heap *);
+
+/* what each takes from the heap, given the buffers it'll get */
+size_t dols_heap(const fsrc_stage_model *ms, const fsrc_iobuf *src, const fsrc_iobuf *dst);
+size_t sols_heap(const fsrc_stage_model *ms, const fsrc_iobuf *src, const fsrc_iobuf *dst);
+size_t dpps_heap(const fsrc_stage_model *ms, const fsrc_iobuf *src, const fsrc_iobuf *dst);
+size_t spps_heap(const fsrc_stage_model *ms, const fsrc_iobuf *src, const fsrc_iobuf *dst);
+size_t wpps_heap(const fsrc_stage_model *ms, const fsrc_iobuf *src, const fsrc_iobuf *dst);
+size_t lpps_heap(const fsrc_stage_model *ms, const fsrc_iobuf *src, const fsrc_iobuf *dst);
+size_t dhbs_heap(const fsrc_stage_model *ms, const fsrc_iobuf *src, const fsrc_iobuf *dst);
+size_t shbs_heap(const fsrc_stage_model *ms, const fsrc_iobuf *src, const fsrc_iobuf *dst);
+size_t mpps_heap(const fsrc_stage_model *ms, const fsrc_iobuf *src, const fsrc_iobuf *dst);
+size_t mhbs_heap(const fsrc_stage_model *ms, const fsrc_iobuf *src, const fsrc_iobuf *dst);
+
+typedef size_t (*fsrc_stage_heap)(const fsrc_stage_model *, const fsrc_iobuf *, const fsrc_iobuf *);
+
+typedef struct fsrc_stage_impl {
+	fsrc_stage_ctor create;
+	fsrc_stage_heap heap;
+} fsrc_stage_impl;
+
+/* the 16 bit fixed point stages only if the spec allows, see FSRC_FIXED */
+static int ifsrc_fixed_wide(const fsrc_spec *spec)
+{
+	return (spec->flags & FSRC_DOUBLE) || spec->ds < FSRC_FIXED16_DS;
+}
 
-fsrc_err fsrc_create(fsrc_cache *lib, fsrc_converter **out, fsrc_spec *spec, size_t nchans)
+static size_t ifsrc_sample_size(const fsrc_spec *spec)
 {
-	/*size_t chunks = MIN(spec->isize / spec->ratio.dn, spec->osize / spec->ratio.up);
+	if(spec->flags & FSRC_FIXED)
+		return ifsrc_fixed_wide(spec) ? sizeof(int32_t) : sizeof(int16_t);
+	if(spec->flags & FSRC_DOUBLE)
+		return sizeof(double);
+	return sizeof(float);
+}
 
-	if(chunks == 0)
-		++chunks;
+/* how a stage of the spec is done */
+static const fsrc_stage_impl *ifsrc_stage_impl(const fsrc_spec *spec, const fsrc_stage_model *ms)
+{
+	static const fsrc_stage_impl dols = { dols_create, dols_heap };
+	static const fsrc_stage_impl sols = { sols_create, sols_heap };
+	static const fsrc_stage_impl dpps = { dpps_create, dpps_heap };
+	static const fsrc_stage_impl spps = { spps_create, spps_heap };
+	static const fsrc_stage_impl wpps = { wpps_create, wpps_heap };
+	static const fsrc_stage_impl lpps = { lpps_create, lpps_heap };
+	static const fsrc_stage_impl dhbs = { dhbs_create, dhbs_heap };
+	static const fsrc_stage_impl shbs = { shbs_create, shbs_heap };
+	static const fsrc_stage_impl mpps = { mpps_create, mpps_heap };
+	static const fsrc_stage_impl mhbs = { mhbs_create, mhbs_heap };
 
-	spec->isize = chunks * spec->ratio.dn;
-	spec->osize = chunks * spec->ratio.dn;*/
+	if(spec->flags & FSRC_FIXED)
+		return ifsrc_fixed_wide(spec) ? &lpps : &wpps;
 
-	fsrc_model design;
-	fsrc_err err = ifsrc_design(lib, spec, &design);
-	if(err != FSRC_S_OK)
-		return err;
+	if(spec->flags & FSRC_USE_FFT)
+		return (spec->flags & FSRC_DOUBLE) ? &dols : &sols;
 
-	size_t nstages = design.nstages;
-	fsrc_stage_model *metas = design.stages;
+	/* only set for the float direct stages, see FSRC_MIXED */
+	int sums = ms->flags & FSRC_WIDE_SUMS;
+
+	if(ms->flags & FSRC_HALFBAND_FILTER)
+		return (spec->flags & FSRC_DOUBLE) ? &dhbs : (sums ? &mhbs : &shbs);
+
+	if(spec->flags & FSRC_DOUBLE)
+		return &dpps;
+
+	return sums ? &mpps : &spps;
+}
+
+static void ifsrc_converter_free(fsrc_converter *src);
+
+/* 
+	the converter for a design, with its memory from heap, which it takes 
+	over, failing or not. the handle itself isn't carved from an arena, 
+	fsrc_create_async swaps its contents
+*/
+static fsrc_err ifsrc_converter_build(fsrc_converter **out, const fsrc_model *design, const fsrc_spec *spec, size_t nchans, fsrc_heap *heap)
+{
+	size_t nstages = design->nstages;
+	const fsrc_stage_model *metas = design->stages;
+
+	fsrc_converter *src = (fsrc_converter*)heap->a.alloc(sizeof(fsrc_converter), heap->a.arg);
+	if(!src) {
+		fsrc_heap_destroy(heap);
+		return FSRC_E_NOMEM;
+	}
 
-	fsrc_converter *src = (fsrc_converter*)malloc(sizeof(fsrc_converter));
 	memset(src, 0, sizeof(fsrc_converter));
+	src->heap = heap;
+
+	fsrc_iobuf *bufs = FSRC_HEAP_ARRAY(heap, fsrc_iobuf, nstages + 1);
+	if(!bufs) {
+		ifsrc_converter_free(src);
+		return FSRC_E_NOMEM;
+	}
+
+	memset(bufs, 0, (nstages + 1) * sizeof(fsrc_iobuf));
 	fsrc_stage **stages = src->stages;
-	fsrc_iobuf *bufs = src->bufs;
+	src->bufs = bufs;
 
-	src->ratio = design.ratio;
+	src->ratio = design->ratio;
 
 	/*src->isize = metas[0].isize;
 	src->osize = metas[nstages - 1].osize;*/
@@ -90,61 +206,471 @@ fsrc_err fsrc_create(fsrc_cache *lib, fsrc_converter **out, fsrc_spec *spec, siz
 	src->nstages = nstages;
 	src->nchans = nchans;
 
-	if(spec->flags & FSRC_DOUBLE) {
+	if(spec->flags & FSRC_FIXED) {
+		if(ifsrc_fixed_wide(spec)) {
+			src->icvt = fsrc_cvt_xl;
+			src->ocvt = fsrc_cvt_lx;
+		} else {
+			src->icvt = fsrc_cvt_xw;
+			src->ocvt = fsrc_cvt_wx;
+		}
+	} else if(spec->flags & FSRC_DOUBLE) {
 		src->icvt = fsrc_cvt_xd;
 		src->ocvt = fsrc_cvt_dx;	
-		src->ss = sizeof(double);
 	} else {
 		src->icvt = fsrc_cvt_xs;
 		src->ocvt = fsrc_cvt_sx;	
-		src->ss = sizeof(float);
 	}	
 
+	src->ss = ifsrc_sample_size(spec);
+
 	size_t bs = src->ss * nchans;
 
-	fsrc_bufsize *sizes = design.sizes;
+	const fsrc_bufsize *sizes = design->sizes;
 	for(size_t i = 0; i <= nstages; ++i) {
 		bufs[i].past = sizes[i].past;
 		bufs[i].size = sizes[i].size;
-		bufs[i].data = fsrc_alloc(bufs[i].size * bs);
+		bufs[i].data = fsrc_heap_alloc(heap, bufs[i].size * bs);
+		if(!bufs[i].data) {
+			ifsrc_converter_free(src);
+			return FSRC_E_NOMEM;
+		}
 	}
 
-	fsrc_stage_ctor ctor;
-	if(spec->flags & FSRC_USE_FFT) {
-		if(spec->flags & FSRC_DOUBLE)
-			ctor = dols_create;
-		else
-			ctor = sols_create;
-	} else {
-		if(spec->flags & FSRC_DOUBLE)
-			ctor = dpps_create;
-		else
-			ctor = spps_create;
+	for(size_t i = 0; i < nstages; ++i) {
+		fsrc_stage_ctor ctor = ifsrc_stage_impl(spec, &metas[i])->create;
+		fsrc_err err = ctor(&metas[i], &stages[i], &bufs[i], &bufs[i + 1], nchans, heap);
+		if(err != FSRC_S_OK) {
+			stages[i] = 0;
+			ifsrc_converter_free(src);
+			return err;
+		}
+	}
+
+	fsrc_reset(src);
+
+	*out = src;
+
+	return FSRC_S_OK;
+}
+
+/* what ifsrc_converter_build takes from the heap, for an arena that fits it */
+static size_t ifsrc_converter_heap(const fsrc_model *design, const fsrc_spec *spec, size_t nchans)
+{
+	size_t nstages = design->nstages;
+	size_t bs = ifsrc_sample_size(spec) * nchans;
+	size_t size = fsrc_heap_need((nstages + 1) * sizeof(fsrc_iobuf));
+
+	fsrc_iobuf bufs[FSRC_MAX_STAGES + 1];
+	memset(bufs, 0, sizeof(bufs));
+	for(size_t i = 0; i <= nstages; ++i) {
+		bufs[i].past = design->sizes[i].past;
+		bufs[i].size = design->sizes[i].size;
+		size += fsrc_heap_need(bufs[i].size * bs);
 	}
 
 	for(size_t i = 0; i < nstages; ++i) {
-		fsrc_err err = ctor(&metas[i], &stages[i], &bufs[i], &bufs[i + 1], nchans);
-		assert(err == FSRC_S_OK);
+		const fsrc_stage_model *ms = &design->stages[i];
+		size += ifsrc_stage_impl(spec, ms)->heap(ms, &bufs[i], &bufs[i + 1]);
 	}
 
-	ifsrc_model_free(&design);
+	return size;
+}
 
-	fsrc_reset(src);
+/* the converter for a design, which it frees */
+static fsrc_err ifsrc_converter_create(fsrc_converter **out, fsrc_model *design, const fsrc_spec *spec, size_t nchans, 
+	const fsrc_allocator *a, int flags)
+{
+	size_t arena = 0;
+	if(flags & FSRC_CREATE_ARENA)
+		arena = ifsrc_converter_heap(design, spec, nchans);
+
+	fsrc_heap *heap = fsrc_heap_create(a, arena);
+	fsrc_err err = heap ? ifsrc_converter_build(out, design, spec, nchans, heap) : FSRC_E_NOMEM;
+	assert(err != FSRC_S_OK || !arena || (*out)->heap->used == arena);
+
+	ifsrc_model_free(design);
+
+	return err;
+}
+
+fsrc_err fsrc_create(fsrc_cache *cache, fsrc_converter **out, fsrc_spec *spec, size_t nchans)
+{
+	return fsrc_create_ex(cache, out, spec, nchans, 0, 0);
+}
+
+fsrc_err fsrc_create_ex(fsrc_cache *lib, fsrc_converter **out, fsrc_spec *spec, size_t nchans, 
+	const fsrc_allocator *alloc, int flags)
+{
+	/*size_t chunks = MIN(spec->isize / spec->ratio.dn, spec->osize / spec->ratio.up);
+
+	if(chunks == 0)
+		++chunks;
+
+	spec->isize = chunks * spec->ratio.dn;
+	spec->osize = chunks * spec->ratio.dn;*/
+
+	fsrc_model design;
+	fsrc_err err = ifsrc_design(lib, spec, &design, 0);
+	if(err != FSRC_S_OK)
+		return err;
+
+	return ifsrc_converter_create(out, &design, spec, nchans, alloc, flags);
+}
+
+/* the converter itself, its buffers and its stages' regions */
+#define FSRC_REGIONS (3 + FSRC_MAX_STAGES * (FSRC_STAGE_REGIONS + 1))
+
+static size_t ifsrc_converter_regions(const fsrc_converter *src, fsrc_region *r)
+{
+	size_t n = 0;
+	r[n].p = src;
+	r[n].size = sizeof(fsrc_converter);
+	r[n++].tab = 0;
+	r[n].p = src->bufs;
+	r[n].size = (src->nstages + 1) * sizeof(fsrc_iobuf);
+	r[n++].tab = 0;
+
+	for(size_t i = 0; i <= src->nstages; ++i) {
+		r[n].p = src->bufs[i].data;
+		r[n].size = src->bufs[i].size * src->nchans * src->ss;
+		r[n++].tab = 0;
+	}
+
+	for(size_t i = 0; i < src->nstages; ++i)
+		n += src->stages[i]->vt->regions(src->stages[i], r + n);
+
+	assert(n <= FSRC_REGIONS);
+	return n;
+}
+
+static void ifsrc_regions_unlock(const fsrc_region *r, size_t n)
+{
+	for(size_t i = 0; i < n; ++i) {
+		if(r[i].tab)
+			fsrc_table_unlock(r[i].tab);
+		else
+			fsrc_mem_unlock(r[i].p, r[i].size);
+	}
+}
+
+/* see fsrc_prepare. if locking fails, what was locked is let go */
+static fsrc_err ifsrc_prepare(fsrc_converter *src, int flags)
+{
+	fsrc_region r[FSRC_REGIONS];
+	size_t n = ifsrc_converter_regions(src, r);
+	int lock = (flags & FSRC_PREPARE_LOCK) && !src->locked;
+
+	for(size_t i = 0; i < n; ++i) {
+		fsrc_err err = FSRC_S_OK;
+		if(r[i].tab) {
+			err = fsrc_table_prepare(r[i].tab, lock);
+		} else {
+			fsrc_mem_touch(r[i].p, r[i].size, 1);
+			if(lock && fsrc_mem_lock(r[i].p, r[i].size))
+				err = FSRC_E_NORSRC;
+		}
+
+		if(err != FSRC_S_OK) {
+			if(lock)
+				ifsrc_regions_unlock(r, i);
+			return err;
+		}
+	}
+
+	src->locked |= lock;
+
+	return FSRC_S_OK;
+}
+
+static void ifsrc_unlock(fsrc_converter *src)
+{
+	if(src->locked) {
+		fsrc_region r[FSRC_REGIONS];
+		ifsrc_regions_unlock(r, ifsrc_converter_regions(src, r));
+		src->locked = 0;
+	}
+}
+
+/* takes a partly built one too, see ifsrc_converter_build */
+static void ifsrc_converter_free(fsrc_converter *src)
+{
+	fsrc_heap *heap = src->heap;
+
+	ifsrc_unlock(src);
+
+	for(size_t i = 0; i < src->nstages; ++i) {
+		if(src->stages[i])
+			src->stages[i]->vt->destroy(src->stages[i]);
+	}
+
+	if(src->bufs) {
+		for(size_t i = 0; i <= src->nstages; ++i)
+			fsrc_heap_free(heap, src->bufs[i].data);
+	}
+
+	fsrc_heap_free(heap, src->bufs);
+	heap->a.free(src, heap->a.arg);
+	fsrc_heap_destroy(heap);
+}
+
+static void fsrc_async_run(void *arg)
+{
+	fsrc_async *a = (fsrc_async*)arg;
+
+	fsrc_converter *next = 0;
+	fsrc_model design;
+	fsrc_err err = ifsrc_design(a->cache, &a->spec, &design, 0);
+
+	/* a minimum phase design's latency is something else entirely */
+	if(err == FSRC_S_OK && !(a->spec.flags & FSRC_LPF_MINPHASE)) {
+		err = ifsrc_model_pad(&design, a->lens);
+		if(err != FSRC_S_OK)
+			ifsrc_model_free(&design);
+	}
+
+	/* the stages have to match to resume. the stand-ins are longer, so their sums are wide enough */
+	for(size_t i = 0; err == FSRC_S_OK && i < design.nstages; ++i)
+		design.stages[i].flags = (design.stages[i].flags & ~FSRC_WIDE_SUMS) | a->sums[i];
+
+	if(err == FSRC_S_OK)
+		err = ifsrc_converter_create(&next, &design, &a->spec, a->src->nchans, 0, 0);
+
+	fsrc_mutex_lock(&a->mutex);
+	/* prepared like the stand-in. if that fails, it's swapped in regardless */
+	if(next && a->prep)
+		ifsrc_prepare(next, a->pflags);
+	a->next = next;
+	a->err = err;
+	a->done = 1;
+	fsrc_mutex_unlock(&a->mutex);
+
+	/* once it's there to be swapped in */
+	if(a->proc)
+		a->proc(a->src, err, a->arg);
+}
+
+fsrc_err fsrc_create_async(fsrc_cache *cache, fsrc_converter **out, fsrc_spec *spec, size_t nchans, fsrc_async_proc proc, void *arg)
+{
+	fsrc_model design;
+	fsrc_err err = ifsrc_design(cache, spec, &design, 1);
+	if(err != FSRC_S_OK)
+		return err;
+
+	size_t quick = design.quick;
+	size_t lens[FSRC_MAX_STAGES] = {0};
+	int sums[FSRC_MAX_STAGES] = {0};
+	for(size_t i = 0; i < design.nstages; ++i) {
+		lens[i] = design.stages[i].n;
+		sums[i] = design.stages[i].flags & FSRC_WIDE_SUMS;
+	}
+
+	fsrc_converter *src;
+	err = ifsrc_converter_create(&src, &design, spec, nchans, 0, 0);
+	if(err != FSRC_S_OK)
+		return err;
+
+	if(quick == 0) {
+		/* it's all cached, nothing to wait for */
+		if(proc)
+			proc(src, FSRC_S_OK, arg);
+		*out = src;
+		return FSRC_S_OK;
+	}
+
+	fsrc_async *a = FSRC_NEW(fsrc_async);
+	if(!a) {
+		ifsrc_converter_free(src);
+		return FSRC_E_NOMEM;
+	}
+
+	err = fsrc_mutex_init(&a->mutex);
+	if(err != FSRC_S_OK) {
+		free(a);
+		ifsrc_converter_free(src);
+		return err;
+	}
+
+	a->done = 0;
+	a->taken = 0;
+	a->next = 0;
+	a->old = 0;
+	a->err = FSRC_E_INTERNAL;
+	a->prep = 0;
+	a->pflags = 0;
+	a->src = src;
+	a->cache = cache;
+	a->spec = *spec;
+	a->proc = proc;
+	a->arg = arg;
+	memcpy(a->lens, lens, sizeof(lens));
+	memcpy(a->sums, sums, sizeof(sums));
+
+	src->async = a;
+
+	err = fsrc_thread_create(&a->thread, fsrc_async_run, a);
+	if(err != FSRC_S_OK) {
+		fsrc_mutex_destroy(&a->mutex);
+		free(a);
+		ifsrc_converter_free(src);
+		return err;
+	}
 
 	*out = src;
 
 	return FSRC_S_OK;
 }
 
-void fsrc_destroy(fsrc_converter *src)
+/*
+	the final converter carries on where the stand-in leaves off. the 
+	decomposition only depends on the ratio and bandwidth, so the stages 
+	match up. the buffers only differ in how much history they keep
+*/
+static int ifsrc_converter_resume(fsrc_converter *dst, const fsrc_converter *src)
 {
+	if(dst->nstages != src->nstages || dst->ss != src->ss || dst->nchans != src->nchans)
+		return 0;
+
+	for(size_t i = 0; i < src->nstages; ++i) {
+		if(dst->stages[i]->up != src->stages[i]->up || dst->stages[i]->dn != src->stages[i]->dn)
+			return 0;
+		if(dst->stages[i]->vt != src->stages[i]->vt)
+			return 0;
+	}
+
+	size_t ss = src->ss;
+	for(size_t i = 0; i <= src->nstages; ++i) {
+		const fsrc_iobuf *sb = &src->bufs[i];
+		fsrc_iobuf *db = &dst->bufs[i];
+
+		/* what hasn't been used yet, and as much history as there is */
+		db->pos = db->past + (sb->pos - sb->past);
+		size_t n = MIN(sb->pos, db->pos);
+
+		const char *s = (const char*)sb->data + (sb->pos - n) * ss;
+		char *d = (char*)db->data;
+		for(size_t c = 0; c < src->nchans; ++c) {
+			memset(d, 0, (db->pos - n) * ss);
+			memcpy(d + (db->pos - n) * ss, s, n * ss);
+			s += sb->size * ss;
+			d += db->size * ss;
+		}
+	}
+
+	/* the output buffer was copied whole, written or not */
+	dst->opos = src->opos;
+
 	for(size_t i = 0; i < src->nstages; ++i)
-		src->stages[i]->vt->destroy(src->stages[i]);
+		dst->stages[i]->vt->resume(dst->stages[i], src->stages[i]);
+
+	return 1;
+}
+
+/* 
+	swaps in the final design once it's done. not while the converter is 
+	being drained, fsrc_end counted on the filters it had. it doesn't wait 
+	for the design thread to let go of the lock, fsrc_pull shouldn't, the 
+	next call will do
+*/
+static void ifsrc_async_swap(fsrc_converter *src)
+{
+	fsrc_async *a = src->async;
+	if(a->taken || src->eos)
+		return;
+
+	if(!fsrc_mutex_trylock(&a->mutex))
+		return;
+	int done = a->done;
+	fsrc_converter *next = a->next;
+	a->next = 0;
+	fsrc_mutex_unlock(&a->mutex);
+
+	if(!done)
+		return;
+	a->taken = 1;
+
+	/* on failure the stand-in stays */
+	if(!next)
+		return;
+
+	if(!ifsrc_converter_resume(next, src))
+		fsrc_reset(next);
+
+	/* the handle stays the same, so the contents are swapped */
+	fsrc_converter t = *src;
+	*src = *next;
+	*next = t;
+	src->async = a;
+	src->iproc = t.iproc;
+	src->iarg = t.iarg;
+	next->async = 0;
+	a->old = next;
+}
+
+/* frees the stand-in once it's been swapped out */
+static void ifsrc_async_trim(fsrc_converter *src)
+{
+	fsrc_async *a = src->async;
+	if(a && a->old) {
+		ifsrc_converter_free(a->old);
+		a->old = 0;
+	}
+}
+
+fsrc_err fsrc_async_wait(fsrc_converter *src)
+{
+	fsrc_async *a = src->async;
+	if(!a)
+		return FSRC_S_OK;
+
+	if(a->thread) {
+		fsrc_thread_join(a->thread);
+		a->thread = 0;
+	}
+
+	ifsrc_async_swap(src);
+	ifsrc_async_trim(src);
+
+	return a->err;
+}
+
+void fsrc_destroy(fsrc_converter *src)
+{
+	fsrc_async *a = src->async;
+	if(a) {
+		if(a->thread)
+			fsrc_thread_join(a->thread);
+		if(a->next)
+			ifsrc_converter_free(a->next);
+		if(a->old)
+			ifsrc_converter_free(a->old);
+		fsrc_mutex_destroy(&a->mutex);
+		free(a);
+	}
+
+	ifsrc_converter_free(src);
+}
 
-	for(size_t i = 0; i <= src->nstages; ++i)
-		fsrc_free(src->bufs[i].data);
+fsrc_err fsrc_prepare(fsrc_converter *src, int flags)
+{
+	int locked = src->locked;
+	fsrc_err err = ifsrc_prepare(src, flags);
+
+	/* the final design too, now or once it's done */
+	fsrc_async *a = src->async;
+	if(a && err == FSRC_S_OK) {
+		fsrc_mutex_lock(&a->mutex);
+		a->prep = 1;
+		a->pflags = flags;
+		if(a->next)
+			err = ifsrc_prepare(a->next, flags);
+		fsrc_mutex_unlock(&a->mutex);
+
+		if(err != FSRC_S_OK && !locked)
+			ifsrc_unlock(src);
+	}
 
-	free(src);
+	return err;
 }
 
 fsrc_ratio fsrc_get_ratio(fsrc_converter *src)
@@ -161,6 +687,11 @@ void fsrc_reset(fsrc_converter *src)
 {
 	src->eos = 0;
 	src->rem = 0;
+	src->opos = 0;
+
+	/* the stand-in isn't freed here, see fsrc_prepare */
+	if(src->async)
+		ifsrc_async_swap(src);
 
 	for(size_t i = 0; i < src->nstages; ++i)
 		src->stages[i]->vt->reset(src->stages[i]);
@@ -191,10 +722,11 @@ size_t fsrc_end(fsrc_converter *src)
 
 			size_t lpf_len = s[i]->n;
 			
-			samps = samps + buf[i].pos - buf[i].past;
+			/* pos can be below the history, see ifsrc_input_need */
+			samps = samps + buf[i].pos > buf[i].past ? samps + buf[i].pos - buf[i].past : 0;
 			samps = (samps * up + lpf_len + dn - 2) / dn;
 		}
-		src->rem = (size_t)samps + buf[n].pos;
+		src->rem = (size_t)samps + buf[n].pos - src->opos;
 		assert(buf[n].past == 0);
 	}
 	return src->rem;
@@ -263,12 +795,44 @@ size_t fsrc_read_split(fsrc_converter *src, size_t bufsize, const fsrc_chandesc
 	return size;
 }
 
+/* 
+	the output buffer is a queue, written from opos on. it's rewound once 
+	it's empty, and what's left is only moved to the front when the last 
+	stage needs the room, see fsrc_process. fsrc_pull never leaves any
+*/
+static void ifsrc_output_taken(fsrc_converter *src, size_t size)
+{
+	fsrc_iobuf *buf = &src->bufs[src->nstages];
+
+	src->opos += size;
+	if(src->opos == buf->pos)
+		src->opos = buf->pos = 0;
+}
+
+static void ifsrc_output_shift(fsrc_converter *src)
+{
+	fsrc_iobuf *buf = &src->bufs[src->nstages];
+	if(src->opos == 0)
+		return;
+
+	size_t n = buf->pos - src->opos;
+	char *d = (char*)buf->data;
+	size_t ds = buf->size * src->ss;
+	for(size_t i = 0; i < src->nchans; ++i) {
+		memmove(d, d + src->opos * src->ss, n * src->ss);
+		d += ds;
+	}
+
+	buf->pos = n;
+	src->opos = 0;
+}
+
 size_t fsrc_write(fsrc_converter *src, const fsrc_bufdesc *desc)
 {
 	fsrc_iobuf *buf = &src->bufs[src->nstages];
 	assert(buf->past == 0);
 
-	size_t size = MIN(buf->pos, desc->size);
+	size_t size = MIN(buf->pos - src->opos, desc->size);
 	if(size == 0)
 		return 0;
 	
@@ -281,7 +845,7 @@ size_t fsrc_write(fsrc_converter *src, const fsrc_bufdesc *desc)
 
 	fsrc_cvt_t cvt_proc = src->ocvt[desc->fmt][0];
 
-	char *d = (char*)buf->data;
+	char *d = (char*)buf->data + src->opos * src->ss;
 	size_t ds = buf->size * src->ss;
 
 	size_t ss = sample_size[desc->fmt];
@@ -292,7 +856,7 @@ size_t fsrc_write(fsrc_converter *src, const fsrc_bufdesc *desc)
 		d += ds;
 	}
 
-	buf->pos -= size;
+	ifsrc_output_taken(src, size);
 	return size;
 }
 
@@ -301,7 +865,7 @@ size_t fsrc_write_split(fsrc_converter *src, size_t bufsize, const fsrc_chandesc
 	fsrc_iobuf *buf = &src->bufs[src->nstages];
 	assert(buf->past == 0);
 
-	size_t size = MIN(buf->pos, bufsize);
+	size_t size = MIN(buf->pos - src->opos, bufsize);
 	if(size == 0)
 		return 0;
 	
@@ -312,7 +876,7 @@ size_t fsrc_write_split(fsrc_converter *src, size_t bufsize, const fsrc_chandesc
 		src->rem -= size;
 	}	
 
-	char *d = (char*)buf->data;
+	char *d = (char*)buf->data + src->opos * src->ss;
 	size_t ds = buf->size * src->ss;
 
 	for(size_t i = 0; i < src->nchans; ++i) {
@@ -321,7 +885,7 @@ size_t fsrc_write_split(fsrc_converter *src, size_t bufsize, const fsrc_chandesc
 		d += ds;
 	}
 
-	buf->pos -= size;
+	ifsrc_output_taken(src, size);
 	return size;
 }
 
@@ -348,20 +912,115 @@ fsrc_err fsrc_process(fsrc_converter *src)
 		fsrc_silence(src);
 	}
 
+	if(src->async)
+		ifsrc_async_swap(src);
+
+	ifsrc_output_shift(src);
+
+	/* 
+		a stage that can't go on doesn't stop the ones after it, they may 
+		have enough buffered. it's all right if the last one made something
+	*/
 	fsrc_stage **stages = src->stages;
 	size_t nstages = src->nstages;
-	for(size_t i = 0; i < nstages; ++i) {
-		fsrc_err err = stages[i]->vt->process(stages[i]);
-		if(err != FSRC_S_OK) {
-			//assert(err == FSRC_S_BUFFER_EMPTY);
-			return err;
-		}
-	}
+	fsrc_err err = FSRC_S_OK;
+	for(size_t i = 0; i < nstages; ++i)
+		err = stages[i]->vt->process(stages[i]);
 
 	/*if(src->eos && src->bufs[src->nstages].pos >= src->rem)
 		return FSRC_S_END;*/
 
-	return FSRC_S_OK;
+	return err;
 	/*return src->bufs[src->nstages].pos;*/
 }
 
+size_t fsrc_push(fsrc_converter *src, const fsrc_bufdesc *desc)
+{
+	fsrc_bufdesc d = *desc;
+	size_t fs = sample_size[desc->fmt] * src->nchans;
+
+	size_t done = 0;
+	for(;;) {
+		d.data = (char*)desc->data + done * fs;
+		d.size = desc->size - done;
+		done += fsrc_read(src, &d);
+		if(done == desc->size || src->eos)
+			break;
+
+		/* the input buffer is full. processing frees some, unless the output is full too */
+		size_t pos = src->bufs[0].pos;
+		fsrc_process(src);
+		if(src->bufs[0].pos == pos)
+			break;
+	}
+
+	return done;
+}
+
+void fsrc_set_input(fsrc_converter *src, fsrc_input_proc proc, void *arg)
+{
+	src->iproc = proc;
+	src->iarg = arg;
+}
+
+/* the input samples n more output samples take, less what's buffered */
+static size_t ifsrc_input_need(fsrc_converter *src, size_t n)
+{
+	fsrc_iobuf *bufs = src->bufs;
+	size_t ns = src->nstages;
+
+	size_t have = bufs[ns].pos - src->opos;
+	n = n > have ? n - have : 0;
+	/* a decimating stage can be owed a sample it skips, pos is below the history then */
+	for(size_t i = ns; i-- > 0;) {
+		n = src->stages[i]->vt->need(src->stages[i], n) + bufs[i].past;
+		have = bufs[i].pos;
+		n = n > have ? n - have : 0;
+	}
+
+	return n;
+}
+
+/* 
+	asks the input callback for what n more output samples take, as much 
+	as fits. 0 if it can't, or the callback claims samples it didn't read
+*/
+static int ifsrc_input(fsrc_converter *src, size_t n)
+{
+	if(!src->iproc || src->eos)
+		return 0;
+
+	fsrc_iobuf *buf = &src->bufs[0];
+	size_t size = MIN(ifsrc_input_need(src, n), buf->size - buf->pos);
+	if(size == 0)
+		return 0;
+
+	size_t pos = buf->pos;
+	if(src->iproc(src, size, src->iarg) == 0) {
+		fsrc_end(src);
+		return 1;
+	}
+
+	return buf->pos > pos;
+}
+
+size_t fsrc_pull(fsrc_converter *src, const fsrc_bufdesc *desc)
+{
+	fsrc_bufdesc d = *desc;
+	size_t fs = sample_size[desc->fmt] * src->nchans;
+
+	size_t done = 0;
+	for(;;) {
+		d.data = (char*)desc->data + done * fs;
+		d.size = desc->size - done;
+		done += fsrc_write(src, &d);
+		if(done == desc->size)
+			break;
+
+		/* the output buffer is empty, so a stage that can't go on needs more input */
+		if(fsrc_process(src) != FSRC_S_OK && !ifsrc_input(src, desc->size - done))
+			break;
+	}
+
+	return done;
+}
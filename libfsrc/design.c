@@ -21,13 +21,21 @@
 #include "design.h"
 #include "rational.h"
 #include "enum_factors.h"
+#include "thread.h"
+#include "fft.h"
 #include <assert.h>
 #include <float.h>
+#include <math.h>
 #include <string.h>
 #include <stdlib.h>
 
-size_t ifsrc_cache_get_lpfs(fsrc_cache *cache, const fsrc_lps *lps, fsrc_lpc *lpc, size_t n);
-fsrc_err ifsrc_cache_lpfs(fsrc_cache *cache, const fsrc_lps *lps, fsrc_lpc *lpc, size_t n);
+size_t ifsrc_cache_get_lpfs(fsrc_cache *cache, const fsrc_lps *lps, fsrc_lpc *lpc, int *shared, size_t n, fsrc_cache_view **view);
+void ifsrc_cache_view_release(fsrc_cache_view *view);
+fsrc_err ifsrc_cache_lpfs(fsrc_cache *cache, const fsrc_lps *lps, const fsrc_lpc *lpc, const int *floats, const double *cost, size_t n);
+size_t ifsrc_cache_get_hint(fsrc_cache *cache, const fsrc_lps *lps, fsrc_lpf_hint *hint);
+
+/* no point in more design threads than this */
+#define FSRC_MAX_THREADS 64
 
 typedef struct fsrc_mstage {
 	fsrc_ratio r;
@@ -48,7 +56,15 @@ typedef struct fsrc_level {
 typedef struct fsrc_factors {
 	fsrc_rational r;
 	double bw;
-	fsrc_level *lev;
+	double dp;		/* split between the stages */
+	double ds;
+	size_t size;	/* periods of the ratio in a block */
+	int rev;		/* the stages run the other way, it's upsampling */
+	int fft;
+	int half;		/* halfband stages can be used */
+	int mixed;		/* float stages may sum in double, see FSRC_MIXED */
+	fsrc_level *lev;	/* the best ones within FSRC_MAX_LPF_LEN, for each length */
+	fsrc_level *any;	/* and regardless */
 } fsrc_factors;
 
 static unsigned gcd(unsigned a, unsigned b)
@@ -62,15 +78,125 @@ static unsigned gcd(unsigned a, unsigned b)
 	return a;
 }
 
-static double cost_func(const fsrc_rational *q, size_t len, double bw, unsigned up, unsigned dn)
+/* rough costs, in multiply-adds */
+#define FSRC_FFT_COST	1.25	/* per n log2 n of a real transform */
+#define FSRC_MOVE_COST	2		/* per sample going into or out of a stage */
+
+/* 
+	the block, in samples at the faster rate, fft stages are costed for. 
+	not the spec's buffer sizes, which would make the stages, and so the 
+	filters to design and cache, depend on them
+*/
+#define FSRC_FFT_BLOCK	8192
+
+/* 
+	the design time grows faster than the filter length, a stage that 
+	needs a longer one than this isn't worth it, unless they all do
+*/
+#define FSRC_MAX_LPF_LEN 4096
+
+/* whether the spec's float stages may sum in double */
+static int ifsrc_mixed(const fsrc_spec *spec)
+{
+	return (spec->flags & (FSRC_MIXED | FSRC_DOUBLE | FSRC_FIXED | FSRC_USE_FFT)) == FSRC_MIXED;
+}
+
+/* a multiply-add summed in double, relative to one in float */
+#define FSRC_WIDE_COST	2
+
+/* 
+	whether a float stage needs double sums, see FSRC_MIXED. the roundings 
+	of the additions are taken as independent, so a phase of n taps is off 
+	by about sqrt(n) half ulps. that has to stay below the stopband ds.
+	L is the stage's upsampling factor
+*/
+static int ifsrc_wide_sums(double ds, double n, unsigned L)
+{
+	double m = ceil(n / L);
+	return sqrt(m) * (FLT_EPSILON / 2) > ds;
+}
+
+/* what a tap of an n tap filter costs to multiply, with mixed set if FSRC_MIXED applies */
+static double ifsrc_tap_cost(int mixed, double ds, double n, unsigned L)
+{
+	return mixed && ifsrc_wide_sums(ds, n, L) ? FSRC_WIDE_COST : 1;
+}
+
+/* 
+	a stage that doubles or halves the rate can use a halfband filter, if 
+	its band edges can be made symmetric about 1/2 without loosening them. 
+	it's worth it if a quarter of the halfband's taps, which is what gets 
+	multiplied, cost less than what the stage would need otherwise. with 
+	mixed, either one may have to sum in double, L is the stage's 
+	upsampling factor. lps is set to the halfband's spec
+*/
+static int ifsrc_halfband(unsigned up, unsigned dn, double fp, double fs, double dp, double ds, int mixed, unsigned L, fsrc_lps *lps)
+{
+	if(!(up == 2 && dn == 1) && !(up == 1 && dn == 2))
+		return 0;
+
+	double w = MIN(0.5 - fp, fs - 0.5);
+	if(w <= 0)
+		return 0;
+
+	double d = MIN(dp, ds);
+	double nh = fsrc_lpf_len(2 * w, d, d);
+	double nf = fsrc_lpf_len(fs - fp, dp, ds);
+	if((nh + 1) / 4 * ifsrc_tap_cost(mixed, d, nh, L) >= nf * ifsrc_tap_cost(mixed, ds, nf, L))
+		return 0;
+
+	memset(lps, 0, sizeof(fsrc_lps));
+	lps->fp = 0.5 - w;
+	lps->fs = 0.5 + w;
+	lps->dp = d;
+	lps->ds = d;
+	lps->flags = FSRC_LPF_HALFBAND;
+
+	return 1;
+}
+
+/* 
+	the cost of a stage per period of the ratio, per channel. Fi and Fo 
+	are its rates, U and D its ratio, n the filter length, of which nm 
+	taps are multiplied
+*/
+static double stage_cost(double Fi, double Fo, double U, double D, double n, double nm, size_t size, int fft)
+{
+	double c = FSRC_MOVE_COST * (Fi + Fo);
+
+	if(!fft)
+		return c + Fo / U * nm;
+
+	/* see ols_src_impl.h. one block per size periods */
+	size_t Ns = (size_t)(size * Fi);
+	size_t Nh = (size_t)ceil(n / U) - 1;
+	size_t K = fsrc_fft_opt_size_high((Ns + Nh + (size_t)D - 1) / (size_t)D, FSRC_FFT_SIZE_ANY);
+	double N = K * D;
+	double M = K * U;
+
+	double b = FSRC_FFT_COST * (N * log2(N) + M * log2(M)) + 2 * M * D;
+
+	return c + b / size;
+}
+
+/* 
+	q are the stages in the downsampling direction, from dn to up.
+	over is set if a filter is longer than FSRC_MAX_LPF_LEN
+*/
+static double cost_func(const fsrc_factors *f, const fsrc_rational *q, size_t len, int *over)
 {
+	unsigned up = f->r.den;
+	unsigned dn = f->r.num;
 	assert(up < dn);
 
-	double Fp = up * (1 + bw);
+	double Fs = up;
+	double Fp = up * f->bw;
+	double dp = f->dp / len;
 
 	unsigned Fi = dn;
 
 	double c = 0;
+	*over = 0;
 	for(size_t i = 0; i < len; ++i) {
 		unsigned ui = q[i].den;
 		unsigned di = q[i].num;
@@ -78,8 +204,27 @@ static double cost_func(const fsrc_rational *q, size_t len, double bw, unsigned
 		unsigned Fo = Fi / di * ui;
 		assert(Fo >= up);
 
-		c += (Fi * Fo) / (2 * MIN(Fi, Fo) - Fp); /* computation rate */
-		/*c += (Fi * ui) / (2 * MIN(Fi, Fo) - Fp);*/ /* filter length */
+		/* the same band edges fsrc_decompose comes up with */
+		double Fhi = (double)Fi * ui;
+		double fp = Fp / Fhi;
+		double fs = (2 * MIN(Fi, Fo) - Fs) / Fhi;
+		double n = fsrc_lpf_len(fs - fp, dp, f->ds);
+		unsigned L = f->rev ? di : ui;
+		double nm = n * ifsrc_tap_cost(f->mixed, f->ds, n, L);
+
+		fsrc_lps hl;
+		if(f->half && ifsrc_halfband(ui, di, fp, fs, dp, f->ds, f->mixed, L, &hl)) {
+			n = fsrc_lpf_len(hl.fs - hl.fp, hl.dp, hl.ds);
+			nm = (n + 1) / 4 * ifsrc_tap_cost(f->mixed, hl.ds, n, L);
+		}
+
+		if(n > FSRC_MAX_LPF_LEN)
+			*over = 1;
+
+		if(f->rev)
+			c += stage_cost(Fo, Fi, di, ui, n, nm, f->size, f->fft);
+		else
+			c += stage_cost(Fi, Fo, ui, di, n, nm, f->size, f->fft);
 
 		Fi = Fo;
 	}
@@ -89,28 +234,37 @@ static double cost_func(const fsrc_rational *q, size_t len, double bw, unsigned
 	return c;
 }
 
-static void eval_factors(fsrc_factors *of, const fsrc_rational *r, size_t len)
+static void eval_level(fsrc_level *fl, double c, const fsrc_rational *r, size_t len)
 {
-	double c = cost_func(r, len, of->bw, of->r.den, of->r.num);
-	fsrc_level *fl = &of->lev[len - 1];
 	if(c < fl->cost) {
 		fl->cost = c;	
 		memcpy(fl->factors, r, len * sizeof(fsrc_rational));
 	}
 }
 
-static fsrc_err fsrc_decompose(fsrc_mdata *ms, fsrc_ratio r, double pbw, int flags)
+static void eval_factors(fsrc_factors *of, const fsrc_rational *r, size_t len)
+{
+	int over;
+	double c = cost_func(of, r, len, &over);
+	if(!over)
+		eval_level(&of->lev[len - 1], c, r, len);
+	eval_level(&of->any[len - 1], c, r, len);
+}
+
+static fsrc_err fsrc_decompose(fsrc_mdata *ms, fsrc_ratio r, const fsrc_spec *spec)
 {
-	fsrc_rational ff[(FSRC_MAX_STAGES * (FSRC_MAX_STAGES + 1)) / 2];
-	fsrc_level lev[FSRC_MAX_STAGES];
+	fsrc_rational ff[FSRC_MAX_STAGES * (FSRC_MAX_STAGES + 1)];
+	fsrc_level lev[2 * FSRC_MAX_STAGES];
 
 	fsrc_rational *pr = ff;
-	for(size_t i = 0; i < FSRC_MAX_STAGES; ++i) {
+	for(size_t i = 0; i < 2 * FSRC_MAX_STAGES; ++i) {
 		lev[i].factors = pr;
 		lev[i].cost = DBL_MAX;
-		pr += i + 1;
+		pr += i % FSRC_MAX_STAGES + 1;
 	}
 
+	double pbw = spec->bw;
+
 	fsrc_factors f;	
 	if(r.up > r.dn) {
 		f.r.num = r.up;
@@ -120,19 +274,32 @@ static fsrc_err fsrc_decompose(fsrc_mdata *ms, fsrc_ratio r, double pbw, int fla
 		f.r.den = r.up;
 	}
 	f.bw = pbw;
+	f.dp = spec->dp;
+	f.ds = spec->ds;
+	f.size = MAX(FSRC_FFT_BLOCK / f.r.num, 1);
+	f.rev = r.up > r.dn;
+	f.fft = (spec->flags & (FSRC_USE_FFT | FSRC_FIXED)) == FSRC_USE_FFT;
+	f.half = !f.fft && !(spec->flags & (FSRC_LPF_MINPHASE | FSRC_FIXED));
+	f.mixed = ifsrc_mixed(spec);
 	f.lev = lev;
+	f.any = lev + FSRC_MAX_STAGES;
 
-	lev[0].factors[0] = f.r;
-	lev[0].cost = cost_func(&f.r, 1, pbw, f.r.den, f.r.num);
+	eval_factors(&f, &f.r, 1);
 
-	int nf = fsrc_enum_factors(FSRC_MAX_STAGES, f.r, (enum_proc_t)eval_factors, &f);
-	
-	/* just choose the two stage design for now */
-	//int n = 1;
-	//int n = (nf < 2) ? 1 : 2;
-	int n = (nf < 3) ? 1 : 3;
+	fsrc_enum_factors(FSRC_MAX_STAGES, f.r, (enum_proc_t)eval_factors, &f);
+
+	/* the cheapest, of those within the length limit if there are any */
+	fsrc_level *best = 0;
+	for(size_t i = 0; i < 2 * FSRC_MAX_STAGES; ++i) {
+		if(i == FSRC_MAX_STAGES && best)
+			break;
+		if(lev[i].cost < DBL_MAX && (!best || lev[i].cost < best->cost))
+			best = &lev[i];
+	}
+
+	int n = (int)(best - lev) % FSRC_MAX_STAGES + 1;
 
-	fsrc_rational *sr = lev[n - 1].factors;
+	fsrc_rational *sr = best->factors;
 
 	assert(f.r.den < f.r.num);
 
@@ -166,7 +333,123 @@ static fsrc_err fsrc_decompose(fsrc_mdata *ms, fsrc_ratio r, double pbw, int fla
 	return FSRC_S_OK;
 }
 
-fsrc_err ifsrc_design(fsrc_cache *des, fsrc_spec *spec, fsrc_model *design)
+typedef struct fsrc_lpf_job {
+	fsrc_lpc *lpc;
+	const fsrc_lps *lps;
+	fsrc_lpf_hint hint;
+	fsrc_err err;
+	double cost;	/* seconds it took */
+} fsrc_lpf_job;
+
+/* the jobs are handed out one at a time to however many threads there are */
+typedef struct fsrc_lpf_pool {
+	fsrc_lpf_job *job;
+	size_t n;
+	size_t next;
+	fsrc_mutex mutex;
+} fsrc_lpf_pool;
+
+static void fsrc_lpf_pool_run(void *arg)
+{
+	fsrc_lpf_pool *pool = (fsrc_lpf_pool*)arg;
+	for(;;) {
+		fsrc_mutex_lock(&pool->mutex);
+		size_t i = pool->next;
+		if(i < pool->n)
+			++pool->next;
+		fsrc_mutex_unlock(&pool->mutex);
+
+		if(i == pool->n)
+			break;
+
+		fsrc_lpf_job *job = &pool->job[i];
+		double t = fsrc_clock();
+		job->err = fsrc_lpf_design(job->lpc, job->lps, &job->hint);
+		job->cost = fsrc_clock() - t;
+	}
+}
+
+/* 
+	designs the missing filters. they're independent, so they're spread 
+	over as many threads as there are processors. errs is optional, and so 
+	is cost, which gets how long each took to design, 0 for those it didn't
+*/
+static fsrc_err fsrc_design_lpfs(fsrc_cache *des, const fsrc_lps *lps, fsrc_lpc *lpc, fsrc_err *errs, double *cost, size_t n)
+{
+	if(n == 0)
+		return FSRC_S_OK;
+
+	fsrc_lpf_job *job = FSRC_ARRAY(fsrc_lpf_job, n);
+	size_t *I = FSRC_ARRAY(size_t, n);
+	if(!job || !I) {
+		free(job);
+		free(I);
+		return FSRC_E_NOMEM;
+	}
+
+	size_t m = 0;
+	for(size_t i = 0; i < n; ++i) {
+		if(errs)
+			errs[i] = FSRC_S_OK;
+		if(cost)
+			cost[i] = 0;
+		if(lpc[i].h == 0) {
+			job[m].lpc = &lpc[i];
+			job[m].lps = &lps[i];
+			job[m].err = FSRC_E_INTERNAL;
+			job[m].cost = 0;
+			/* warm start from similar cached designs, if there are any */
+			ifsrc_cache_get_hint(des, &lps[i], &job[m].hint);
+			I[m++] = i;
+		}
+	}
+
+	fsrc_lpf_pool pool;
+	pool.job = job;
+	pool.n = m;
+	pool.next = 0;
+	fsrc_err err = fsrc_mutex_init(&pool.mutex);
+	if(err == FSRC_S_OK) {
+		fsrc_thread thread[FSRC_MAX_THREADS];
+		size_t nt = MIN(m, MIN(fsrc_thread_count(), FSRC_MAX_THREADS));
+
+		/* this thread is one of them */
+		size_t k = 0;
+		for(size_t i = 1; i < nt; ++i) {
+			if(fsrc_thread_create(&thread[k], fsrc_lpf_pool_run, &pool) == FSRC_S_OK)
+				++k;
+		}
+
+		fsrc_lpf_pool_run(&pool);
+
+		for(size_t i = 0; i < k; ++i)
+			fsrc_thread_join(thread[i]);
+
+		fsrc_mutex_destroy(&pool.mutex);
+	} else {
+		for(size_t i = 0; i < m; ++i)
+			job[i].err = err;
+	}
+
+	err = FSRC_S_OK;
+	for(size_t i = 0; i < m; ++i) {
+		fsrc_free(job[i].hint.lpc.h);
+		if(job[i].err != FSRC_S_OK)
+			err = job[i].err;
+		if(errs)
+			errs[I[i]] = job[i].err;
+		if(cost)
+			cost[I[i]] = job[i].cost;
+	}
+
+	free(job);
+	free(I);
+
+	return err;
+}
+
+/* the ratio in lowest terms, how it's split into stages, and the stages' filter specs */
+static fsrc_err ifsrc_design_lps(const fsrc_spec *spec, fsrc_ratio *pr, fsrc_mdata *ms, fsrc_lps *lps)
 {
 	fsrc_ratio r = spec->fr;
 
@@ -178,12 +461,78 @@ fsrc_err ifsrc_design(fsrc_cache *des, fsrc_spec *spec, fsrc_model *design)
 	r.up /= div;
 	r.dn /= div;
 
+	if(r.up == 1 && r.dn == 1)
+		return FSRC_E_INVARG;
+
+	fsrc_err ret = fsrc_decompose(ms, r, spec);
+	if(ret != FSRC_S_OK)
+		return ret;
+
+	memset(lps, 0, sizeof(fsrc_lps) * ms->n);
+
+	double dp = spec->dp / ms->n;
+	double ds = spec->ds;
+	int flags = spec->flags & FSRC_LPF_MINPHASE;
+
+	/* only the floating point direct stages make use of them, see fsrc_decompose */
+	int half = !(spec->flags & (FSRC_USE_FFT | FSRC_FIXED)) && !flags;
+	int mixed = ifsrc_mixed(spec);
+
+	for(size_t i = 0; i < ms->n; ++i) {
+		lps[i].fp = ms->s[i].fp;
+		lps[i].fs = ms->s[i].fs;
+		lps[i].dp = dp;
+		lps[i].ds = ds;
+		lps[i].flags = flags;		
+
+		unsigned L = r.up < r.dn ? ms->s[i].r.up : ms->s[i].r.dn;
+		if(half)
+			ifsrc_halfband(ms->s[i].r.up, ms->s[i].r.dn, lps[i].fp, lps[i].fs, dp, ds, mixed, L, &lps[i]);
+	}
+
+	*pr = r;
+
+	return FSRC_S_OK;
+}
+
+/* fill in buffer sizes */
+static void ifsrc_model_sizes(fsrc_model *design, size_t isize)
+{
+	fsrc_stage_model *s = design->stages;
+	fsrc_bufsize *bs = design->sizes;
+
+	size_t osize = isize;
+	for(size_t i = 0; i < design->nstages; ++i) {
+		size_t Li = s[i].ratio.up;
+		size_t Mi = s[i].ratio.dn;
+
+		/* hack: implement negative positions? */
+		/* Mi > ms[i].n shouldn't happen unless the desired quality is quite bad. */
+		/* in which case you probably should use a different of resampling anyway. */
+		size_t past = (MAX(s[i].n, Mi) + Li - 1) / Li - 1;
+
+		bs[i].past = past;
+		bs[i].size = osize + past;
+
+		osize = osize / Mi * Li;
+	}
+
+	bs[design->nstages].past = 0;
+	bs[design->nstages].size = osize;
+}
+
+fsrc_err ifsrc_design(fsrc_cache *des, fsrc_spec *spec, fsrc_model *design, int quick)
+{
+	fsrc_ratio r;
+	fsrc_mdata ms;
+	fsrc_lps lps[FSRC_MAX_STAGES];
+	fsrc_err ret = ifsrc_design_lps(spec, &r, &ms, lps);
+	if(ret != FSRC_S_OK)
+		return ret;
+
 	unsigned up = r.up;
 	unsigned dn = r.dn;
 
-	if(up == 1 && dn == 1)
-		return FSRC_E_INVARG;
-
 	size_t size = MIN((spec->isize + dn - 1) / dn, (spec->osize + up - 1) / up);
 	if(size == 0)
 		return FSRC_E_INVARG;
@@ -197,55 +546,97 @@ fsrc_err ifsrc_design(fsrc_cache *des, fsrc_spec *spec, fsrc_model *design)
 	spec->isize = size * dn;
 	spec->osize = size * up;
 
-	fsrc_mdata ms;
-	fsrc_err ret = fsrc_decompose(&ms, r, spec->bw, 0);
-	if(ret != FSRC_S_OK)
-		return ret;
-
 	memset(design, 0, sizeof(fsrc_model));
 
 	design->ratio = r;
 
 	fsrc_stage_model *s = design->stages;
 
-	fsrc_lps lps[FSRC_MAX_STAGES];
 	fsrc_lpc lpc[FSRC_MAX_STAGES];
-
-	memset(lps, 0, sizeof(lps));
 	memset(lpc, 0, sizeof(lpc));
 
-	double dp = spec->dp / ms.n;
-	double ds = spec->ds;
-	int flags = spec->flags & FSRC_LPF_MINPHASE;
+	/* filters found in a mapped cache are used in place, unless they had to be unpacked */
+	fsrc_cache_view *view;
+	int shared[FSRC_MAX_STAGES];
+	size_t found = ifsrc_cache_get_lpfs(des, lps, lpc, shared, ms.n, &view);
 
+	int sflags[FSRC_MAX_STAGES];
+	int had[FSRC_MAX_STAGES];
 	for(size_t i = 0; i < ms.n; ++i) {
-		lps[i].fp = ms.s[i].fp;
-		lps[i].fs = ms.s[i].fs;
-		lps[i].dp = dp;
-		lps[i].ds = ds;
-		lps[i].flags = flags;		
+		sflags[i] = shared[i] ? FSRC_SHARED_FILTER : 0;
+		if(lps[i].flags & FSRC_LPF_HALFBAND)
+			sflags[i] |= FSRC_HALFBAND_FILTER;
+		if(!(lps[i].flags & FSRC_LPF_MINPHASE))
+			sflags[i] |= FSRC_SYMMETRIC_FILTER;
+		had[i] = lpc[i].h != 0;
 	}
 
-	if(ifsrc_cache_get_lpfs(des, lps, lpc, ms.n) < ms.n) {
-		for(size_t i = 0; i < ms.n; ++i) {
-			if(lpc[i].h == 0) {
-				fsrc_err err = fsrc_lpf_design(&lpc[i], &lps[i]);
-				if(err != FSRC_S_OK) {
-					for(size_t j = 0; j < ms.n; ++j) {
-						free(lpc[i].h);
-					}
-					return err;
+	fsrc_err err = FSRC_S_OK;
+	if(found < ms.n && quick) {
+		/* stand-ins for the missing ones, not worth caching */
+		for(size_t i = 0; i < ms.n && err == FSRC_S_OK; ++i) {
+			if(!had[i]) {
+				fsrc_lpf_hint hint;
+				ifsrc_cache_get_hint(des, &lps[i], &hint);
+				err = fsrc_lpf_window(&lpc[i], &lps[i], &hint);
+				fsrc_free(hint.lpc.h);
+				++design->quick;
+			}
+		}
+	} else if(found < ms.n) {
+		double cost[FSRC_MAX_STAGES];
+		err = fsrc_design_lpfs(des, lps, lpc, 0, cost, ms.n);
+		if(err == FSRC_S_OK) {
+			/* only the new ones, a filter found may have been designed to another spec */
+			fsrc_lps nl[FSRC_MAX_STAGES];
+			fsrc_lpc nc[FSRC_MAX_STAGES];
+			double ncost[FSRC_MAX_STAGES];
+			int floats[FSRC_MAX_STAGES];
+			size_t k = 0;
+			for(size_t i = 0; i < ms.n; ++i) {
+				if(!had[i]) {
+					nl[k] = lps[i];
+					nc[k] = lpc[i];
+					ncost[k] = cost[i];
+					floats[k] = spec->flags & FSRC_CACHE_FLOATS;
+					++k;
 				}
 			}
+			ifsrc_cache_lpfs(des, nl, nc, floats, ncost, k);
 		}
-		ifsrc_cache_lpfs(des, lps, lpc, ms.n);
 	}	
+
+	if(err != FSRC_S_OK) {
+		for(size_t j = 0; j < ms.n; ++j) {
+			if(!(sflags[j] & FSRC_SHARED_FILTER))
+				fsrc_free(lpc[j].h);
+		}
+		ifsrc_cache_view_release(view);
+		return err;
+	}
+
+	design->view = view;
+
+	if(ifsrc_mixed(spec)) {
+		for(size_t i = 0; i < ms.n; ++i) {
+			unsigned L = up < dn ? ms.s[i].r.up : ms.s[i].r.dn;
+			if(ifsrc_wide_sums(lps[i].ds, (double)lpc[i].n, L))
+				sflags[i] |= FSRC_WIDE_SUMS;
+		}
+	}
+
+	/* the stand-ins' tables aren't cached either */
+	fsrc_cache *tc[FSRC_MAX_STAGES];
+	for(size_t i = 0; i < ms.n; ++i)
+		tc[i] = (spec->flags & FSRC_CACHE_TABLES) && (had[i] || !quick) ? des : 0;
 	
 	if(up < dn) {
 		for(size_t i = 0; i < ms.n; ++i) {
 			s[i].ratio = ms.s[i].r;
 			s[i].h = lpc[i].h;
 			s[i].n = lpc[i].n;
+			s[i].flags = sflags[i];
+			s[i].cache = tc[i];
 		}
 	} else {
 		for(size_t i = 0; i < ms.n; ++i) {
@@ -254,33 +645,44 @@ fsrc_err ifsrc_design(fsrc_cache *des, fsrc_spec *spec, fsrc_model *design)
 			s[j].ratio.dn = ms.s[i].r.up;
 			s[j].h = lpc[i].h;
 			s[j].n = lpc[i].n;
+			s[j].flags = sflags[i];
+			s[j].cache = tc[i];
 		}
 	}
 
-	/* fill in buffer sizes */
-
-	fsrc_bufsize *bs = design->sizes;
-
-	size_t osize = size * dn;
-	for(size_t i = 0; i < ms.n; ++i) {
-		size_t Li = s[i].ratio.up;
-		size_t Mi = s[i].ratio.dn;
-
-		/* hack: implement negative positions? */
-		/* Mi > ms[i].n shouldn't happen unless the desired quality is quite bad. */
-		/* in which case you probably should use a different of resampling anyway. */
-		size_t past = (MAX(s[i].n, Mi) + Li - 1) / Li - 1;
+	design->nstages = ms.n;
+	ifsrc_model_sizes(design, size * dn);
 
-		bs[i].past = past;
-		bs[i].size = osize + past;
+	return FSRC_S_OK;
+}
 
-		osize = osize / Mi * Li;
+fsrc_err ifsrc_model_pad(fsrc_model *design, const size_t *n)
+{
+	for(size_t i = 0; i < design->nstages; ++i) {
+		fsrc_stage_model *s = &design->stages[i];
+		if(n[i] <= s->n + 1)
+			continue;
+
+		/* an even number of zeros keeps it symmetric, half a tap may be left over */
+		size_t p = (n[i] - s->n) / 2;
+		size_t m = s->n + 2 * p;
+		double *h = (double*)fsrc_alloc(m * sizeof(double));
+		if(!h)
+			return FSRC_E_NOMEM;
+
+		memset(h, 0, m * sizeof(double));
+		memcpy(h + p, s->h, s->n * sizeof(double));
+		if(!(s->flags & FSRC_SHARED_FILTER))
+			fsrc_free(s->h);
+
+		s->h = h;
+		s->n = m;
+		s->flags &= ~FSRC_SHARED_FILTER;
+		/* the tables are for a filter nobody else uses */
+		s->cache = 0;
 	}
 
-	bs[ms.n].past = 0;
-	bs[ms.n].size = osize;
-
-	design->nstages = ms.n;
+	ifsrc_model_sizes(design, design->sizes[0].size - design->sizes[0].past);
 
 	return FSRC_S_OK;
 }
@@ -291,7 +693,7 @@ fsrc_err fsrc_cache_design(fsrc_cache *cache, fsrc_spec *spec)
 	if(cache == 0)
 		return FSRC_E_INVARG;
 
-	fsrc_err err = ifsrc_design(cache, spec, &design);
+	fsrc_err err = ifsrc_design(cache, spec, &design, 0);
 	if(err == FSRC_S_OK) {
 		ifsrc_model_free(&design);
 	}
@@ -299,11 +701,159 @@ fsrc_err fsrc_cache_design(fsrc_cache *cache, fsrc_spec *spec)
 	return err;
 }
 
+/* a stage filter one of the specs in a batch needs */
+typedef struct fsrc_batch_lpf {
+	fsrc_lps lps;
+	size_t spec;
+	size_t k;	/* which of the distinct filters it is */
+} fsrc_batch_lpf;
+
+#define FSRC_CMP(a, b) ((a) < (b) ? -1 : (a) > (b))
+
+/* field by field, the padding may hold anything */
+static int fsrc_batch_lpf_cmp(const void *l, const void *r)
+{
+	const fsrc_lps *a = &((const fsrc_batch_lpf*)l)->lps;
+	const fsrc_lps *b = &((const fsrc_batch_lpf*)r)->lps;
+	int c = FSRC_CMP(a->fs, b->fs);
+	if(!c)
+		c = FSRC_CMP(a->fp, b->fp);
+	if(!c)
+		c = FSRC_CMP(a->dp, b->dp);
+	if(!c)
+		c = FSRC_CMP(a->ds, b->ds);
+	if(!c)
+		c = FSRC_CMP(a->flags, b->flags);
+	return c;
+}
+
+#undef FSRC_CMP
+
+fsrc_err fsrc_cache_design_batch(fsrc_cache *cache, const fsrc_spec *specs, size_t n, fsrc_err *errs)
+{
+	if(cache == 0 || n == 0)
+		return FSRC_E_INVARG;
+
+	size_t m = n * FSRC_MAX_STAGES;
+	fsrc_err *se = FSRC_ARRAY(fsrc_err, n);
+	fsrc_batch_lpf *bf = FSRC_ARRAY(fsrc_batch_lpf, m);
+	fsrc_lps *lps = FSRC_ARRAY(fsrc_lps, m);
+	fsrc_lpc *lpc = FSRC_ARRAY(fsrc_lpc, m);
+	int *shared = FSRC_ARRAY(int, m);
+	int *floats = FSRC_ARRAY(int, m);
+	fsrc_err *fe = FSRC_ARRAY(fsrc_err, m);
+	double *cost = FSRC_ARRAY(double, m);
+	int *had = FSRC_ARRAY(int, m);
+
+	fsrc_err err = FSRC_E_NOMEM;
+	if(!se || !bf || !lps || !lpc || !shared || !floats || !fe || !cost || !had)
+		goto cleanup;
+
+	size_t nf = 0;
+	for(size_t i = 0; i < n; ++i) {
+		fsrc_ratio r;
+		fsrc_mdata ms;
+		fsrc_lps sl[FSRC_MAX_STAGES];
+		se[i] = ifsrc_design_lps(&specs[i], &r, &ms, sl);
+		for(size_t j = 0; se[i] == FSRC_S_OK && j < ms.n; ++j) {
+			bf[nf].lps = sl[j];
+			bf[nf].spec = i;
+			++nf;
+		}
+	}
+
+	/* specs often share filters, design each only once */
+	qsort(bf, nf, sizeof(fsrc_batch_lpf), fsrc_batch_lpf_cmp);
+
+	size_t u = 0;
+	for(size_t i = 0; i < nf; ++i) {
+		if(i == 0 || fsrc_batch_lpf_cmp(&bf[i - 1], &bf[i])) {
+			lps[u] = bf[i].lps;
+			lpc[u].n = 0;
+			lpc[u].h = 0;
+			floats[u] = 0;
+			++u;
+		}
+		bf[i].k = u - 1;
+		floats[u - 1] |= specs[bf[i].spec].flags & FSRC_CACHE_FLOATS;
+	}
+
+	fsrc_cache_view *view = 0;
+	if(u)
+		ifsrc_cache_get_lpfs(cache, lps, lpc, shared, u, &view);
+
+	for(size_t i = 0; i < u; ++i)
+		had[i] = lpc[i].h != 0;
+
+	fsrc_design_lpfs(cache, lps, lpc, fe, cost, u);
+
+	for(size_t i = 0; i < nf; ++i) {
+		if(fe[bf[i].k] != FSRC_S_OK)
+			se[bf[i].spec] = fe[bf[i].k];
+	}
+
+	/* 
+		whatever was designed gets stored in one go. a filter found may have 
+		been designed to another spec, so those aren't
+	*/
+	size_t k = 0;
+	for(size_t i = 0; i < u; ++i) {
+		if(had[i]) {
+			if(!shared[i])
+				fsrc_free(lpc[i].h);
+		} else if(lpc[i].h) {
+			lps[k] = lps[i];
+			lpc[k] = lpc[i];
+			floats[k] = floats[i];
+			cost[k] = cost[i];
+			++k;
+		}
+	}
+
+	err = ifsrc_cache_lpfs(cache, lps, lpc, floats, cost, k);
+
+	for(size_t i = 0; i < k; ++i)
+		fsrc_free(lpc[i].h);
+	ifsrc_cache_view_release(view);
+
+	/* the tables come from the stages, so make them */
+	for(size_t i = 0; i < n; ++i) {
+		if(se[i] == FSRC_S_OK && (specs[i].flags & FSRC_CACHE_TABLES)) {
+			fsrc_spec spec = specs[i];
+			fsrc_converter *cvt;
+			se[i] = fsrc_create(cache, &cvt, &spec, 1);
+			if(se[i] == FSRC_S_OK)
+				fsrc_destroy(cvt);
+		}
+	}
+
+	for(size_t i = 0; i < n && err == FSRC_S_OK; ++i)
+		err = se[i];
+
+	if(errs)
+		memcpy(errs, se, n * sizeof(fsrc_err));
+
+cleanup:
+	free(se);
+	free(bf);
+	free(lps);
+	free(lpc);
+	free(shared);
+	free(floats);
+	free(fe);
+	free(cost);
+	free(had);
+
+	return err;
+}
+
 void ifsrc_model_free(fsrc_model *model)
 {
 	for(size_t i = 0; i < model->nstages; ++i) {
-		fsrc_free(model->stages[i].h);
+		if(!(model->stages[i].flags & FSRC_SHARED_FILTER))
+			fsrc_free(model->stages[i].h);
 	}
+	ifsrc_cache_view_release(model->view);
 }
 
 
@@ -24,6 +24,11 @@
 #include "lpf_design.h"
 
 #define FSRC_SYMMETRIC_FILTER	0x0001
+#define FSRC_SHARED_FILTER		0x0002 /* h points into the cache's mapping */
+#define FSRC_HALFBAND_FILTER	0x0004 /* see FSRC_LPF_HALFBAND */
+#define FSRC_WIDE_SUMS			0x0008 /* a float stage sums in double, see FSRC_MIXED */
+
+typedef struct fsrc_cache_view fsrc_cache_view;
 
 typedef struct fsrc_bufsize {
 	size_t past;
@@ -38,6 +43,8 @@ typedef struct fsrc_stage_model {
 
 	int flags;
 
+	fsrc_cache *cache; /* where the stage tables are cached, may be null */
+
 	/*size_t isize;
 	size_t osize;*/
 } fsrc_stage_model;
@@ -47,11 +54,23 @@ typedef struct fsrc_model {
 	size_t nstages;
 	fsrc_stage_model stages[FSRC_MAX_STAGES];
 	fsrc_bufsize sizes[FSRC_MAX_STAGES + 1];
+	fsrc_cache_view *view; /* keeps the shared filters mapped */
+	size_t quick; /* how many of the filters are stand-ins */
 } fsrc_model;
 
 #include "lpf_design.h"
 
-fsrc_err ifsrc_design(fsrc_cache *des, fsrc_spec *spec, fsrc_model *design);
+/* 
+	with quick set, the filters that aren't cached are stand-ins that take 
+	no time to design, see fsrc_create_async
+*/
+fsrc_err ifsrc_design(fsrc_cache *des, fsrc_spec *spec, fsrc_model *design, int quick);
+/* 
+	zero pads the filters to n taps, where they're shorter, so the latency 
+	stays the same when a design replaces the stand-ins. those are made 
+	longer than the final filters should turn out, see fsrc_lpf_window
+*/
+fsrc_err ifsrc_model_pad(fsrc_model *design, const size_t *n);
 void ifsrc_model_free(fsrc_model *model);
 
 #endif
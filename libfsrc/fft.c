@@ -20,9 +20,13 @@
 #include "ifsrc.h"
 #include "fft.h"
 #include "nearest.h"
+#include "thread.h"
 
 #include <fftw3.h>
 
+/* only the fftw executor is thread safe, the planner isn't */
+static fsrc_mutex fsrc_planner_lock = FSRC_MUTEX_INIT;
+
 #ifdef LIBFSRC_64
 
 #define fftw_iodim fftw_iodim64
@@ -26,7 +26,9 @@ fsrc_err X(rcdft_init)(X(fft) *dft, size_t N, REAL *src, X(complex) *dst, int fl
 		flags = FFTW_DESTROY_INPUT | FFTW_ESTIMATE;
 
 	F(iodim) dim = { N, 1, 1 };
+	fsrc_mutex_lock(&fsrc_planner_lock);
 	*dft = (X(fft))F(plan_guru_dft_r2c)(1, &dim, 0, 0, src, dst, flags);
+	fsrc_mutex_unlock(&fsrc_planner_lock);
 	if(*dft)
 		return FSRC_S_OK;
 	return FSRC_E_EXTERNAL;
@@ -40,7 +42,9 @@ fsrc_err X(crdft_init)(X(fft) *dft, size_t N, X(complex) *src, REAL *dst, int fl
 		flags = FFTW_DESTROY_INPUT | FFTW_ESTIMATE;
 
 	F(iodim) dim = { N, 1, 1 };
+	fsrc_mutex_lock(&fsrc_planner_lock);
 	*dft = (X(fft))F(plan_guru_dft_c2r)(1, &dim, 0, 0, src, dst, flags);
+	fsrc_mutex_unlock(&fsrc_planner_lock);
 	if(*dft)
 		return FSRC_S_OK;
 	return FSRC_E_EXTERNAL;
@@ -71,7 +75,9 @@ fsrc_err X(dtt_init)(X(fft) *dtt, size_t N, REAL *src, REAL *dst, fsrc_dtt_kind
 
 	fftw_iodim dim = { N, 1, 1 };
 	fftw_r2r_kind type = dtt_kind[kind];
+	fsrc_mutex_lock(&fsrc_planner_lock);
 	*dtt = (X(fft))F(plan_guru_r2r)(1, &dim, 0, 0, src, dst, &type, flags);
+	fsrc_mutex_unlock(&fsrc_planner_lock);
 	if(*dtt)
 		return FSRC_S_OK;
 	return FSRC_E_EXTERNAL;
@@ -84,7 +90,9 @@ void X(dtt)(X(fft) dft, REAL *src, REAL *dst)
 
 void X(fft_destroy)(X(fft) fft)
 {
+	fsrc_mutex_lock(&fsrc_planner_lock);
 	F(destroy_plan)((F(plan))fft);	
+	fsrc_mutex_unlock(&fsrc_planner_lock);
 }
 
 #undef F__
@@ -47,6 +47,7 @@
 
 #else
 #include <unistd.h>
+#include <sys/mman.h>
 #endif
 
 #ifndef O_BINARY
@@ -190,6 +191,17 @@ static void fsrc_fioi_unlock(intptr_t file)
 	DWORD Err = GetLastError();
 }
 
+static int fsrc_fioi_same(intptr_t a, intptr_t b)
+{
+	BY_HANDLE_FILE_INFORMATION fa, fb;
+	if(!GetFileInformationByHandle((HANDLE)_get_osfhandle((int)a), &fa))
+		return 0;
+	if(!GetFileInformationByHandle((HANDLE)_get_osfhandle((int)b), &fb))
+		return 0;
+	return fa.dwVolumeSerialNumber == fb.dwVolumeSerialNumber 
+		&& fa.nFileIndexHigh == fb.nFileIndexHigh && fa.nFileIndexLow == fb.nFileIndexLow;
+}
+
 #else
 
 static int fsrc_fioi_setsize(intptr_t file, fsrc_off off)
@@ -228,10 +240,46 @@ static void fsrc_fioi_unlock(intptr_t file)
 	fcntl((int)file, F_SETLKW, &fl);  /* F_GETLK, F_SETLK, F_SETLKW */
 }
 
+static int fsrc_fioi_same(intptr_t a, intptr_t b)
+{
+	struct stat sa, sb;
+	if(fstat((int)a, &sa) || fstat((int)b, &sb))
+		return 0;
+	return sa.st_dev == sb.st_dev && sa.st_ino == sb.st_ino;
+}
+
+static const void *fsrc_fioi_map(intptr_t file, fsrc_off size)
+{
+	if(size <= 0 || (unsigned long long)size > SIZE_MAX)
+		return 0;
+	void *ptr = mmap(0, (size_t)size, PROT_READ, MAP_SHARED, (int)file, 0);
+	if(ptr == MAP_FAILED)
+		return 0;
+	return ptr;
+}
+
+static void fsrc_fioi_unmap(const void *ptr, fsrc_off size)
+{
+	munmap((void*)ptr, (size_t)size);
+}
+
+static int fsrc_fioi_rename(const fsrc_ioi **pioi, const char *from, const char *to)
+{
+	fsrc_file_ioi *ioi = (fsrc_file_ioi*)pioi;
+	char *src = fsrc_fioi_path(ioi, from);
+	char *dst = fsrc_fioi_path(ioi, to);
+	int ret = -1;
+	if(src && dst)
+		ret = rename(src, dst);
+	free(src);
+	free(dst);
+	return ret ? -1 : 0;
+}
+
 #endif
 
 
-fsrc_err fsrc_file_ioi_create(const char *dir, int mode, const fsrc_ioi ***pvt)
+fsrc_err fsrc_file_ioi_create(const char *dir, int mode, const fsrc_ioi ***pvt, const fsrc_ioi_ext **pext)
 {
 	static const fsrc_ioi vt = {
 		fsrc_fioi_dispose,
@@ -244,7 +292,20 @@ fsrc_err fsrc_file_ioi_create(const char *dir, int mode, const fsrc_ioi ***pvt)
 		fsrc_fioi_getsize,
 		fsrc_fioi_setsize,
 		fsrc_fioi_lock,
-		fsrc_fioi_unlock,
+		fsrc_fioi_unlock
+	};
+
+	static const fsrc_ioi_ext ext = {
+		sizeof(fsrc_ioi_ext),
+#ifndef _WIN32
+		fsrc_fioi_map,
+		fsrc_fioi_unmap,
+		fsrc_fioi_rename,
+#else
+		/* can't rename over a file someone has open */
+		0, 0, 0,
+#endif
+		fsrc_fioi_same
 	};
 
 	size_t len = strlen(dir);
@@ -264,6 +325,7 @@ fsrc_err fsrc_file_ioi_create(const char *dir, int mode, const fsrc_ioi ***pvt)
 #endif
 		pioi->len = len;
 		*pvt = &pioi->vt;
+		*pext = &ext;
 		return FSRC_S_OK;
 	}
 	free(pioi);
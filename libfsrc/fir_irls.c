@@ -28,19 +28,200 @@
 #include "xblas.h"
 
 #define IRLS_GRID_DENS 12
+/* 
+	cold starts iterate on a sparse grid with inexact solves first, 
+	until the coefficients change by less than IRLS_REFINE_TOL
+*/
+#define IRLS_COARSE_DENS 3
+#define IRLS_COARSE_PCG_TOL 1e-8
+#define IRLS_REFINE_TOL 1e-3
 #define IRLS_MAX_ITER 200
 #define IRLS_MAX_PCG_ITER 1000
 #define IRLS_ALPHA 1.25
 
-int fir_irls(const fir_irls_spec *spec, fir_irls_info *inf)
+/* resample w0 at x, staying within [xl, xr] */
+static double irls_sample(const double *w0, size_t nw0, double x, size_t xl, size_t xr)
+{
+	size_t i = (size_t)x;
+	if(i >= nw0 - 1)
+		i = nw0 - 2;
+	double t = x - i;
+	double a = w0[i];
+	double b = w0[i + 1];
+	if(a > 0 && b > 0)
+		return a + t * (b - a);
+
+	/* next to a band edge of the old design: use the closest nonzero weight */
+	for(size_t k = 0; ; ++k) {
+		int in = 0;
+		if(i >= xl + k) {
+			if(w0[i - k] > 0)
+				return w0[i - k];
+			in = 1;
+		}
+		if(i + 1 + k <= xr) {
+			if(w0[i + 1 + k] > 0)
+				return w0[i + 1 + k];
+			in = 1;
+		}
+		if(!in)
+			return 0;
+	}
+}
+
+/* initialize the weights from a previous design. fails if the band layout doesn't fit */
+static int irls_load_weights(double *W, size_t grid_len, const size_t *n0, size_t m, const double *w0, size_t nw0)
+{
+	double sc = (double)(nw0 - 1) / (grid_len - 1);
+	for(size_t i = 0; i < m; ++i) {
+		size_t nl = n0[2 * i];
+		size_t nr = n0[2 * i + 1];
+		if(nl >= nr)
+			continue;
+		size_t xl = (size_t)(nl * sc);
+		size_t xr = MIN((size_t)ceil((nr - 1) * sc), nw0 - 1);
+		for(size_t j = nl; j < nr; ++j) {
+			W[j] = irls_sample(w0, nw0, j * sc, xl, xr);
+			if(W[j] == 0)
+				return 0;
+		}
+	}
+	return 1;
+}
+
+/* turns the frequency response H into the weight update envelope */
+static void irls_envelope(double *H, const double *D, const double *A, const size_t *n0, size_t m, size_t grid_len)
+{
+	/* compute the error envelope */
+	for(size_t j = 0; j < grid_len; ++j)
+		H[j] = pow(D[j] * fabs(H[j] - A[j]), IRLS_ALPHA);
+
+	for(size_t i = 0; i < m; ++i) {
+		size_t nl = n0[2 * i];
+		size_t nr = n0[2 * i + 1];
+
+		while (nl < nr - 1) {
+			// find the next peak
+			size_t j = nl + 1;
+			while(j < nr - 1 && (H[j - 1] > H[j] || H[j] < H[j + 1]))
+				++j;
+			// perform linear interpolation
+			double a = (H[j] - H[nl]) / (j - nl);
+			double c = H[nl] - a * nl;
+			for(size_t k = nl; k < j; ++k) {
+				double y = a * k + c;
+				H[k] = MAX(H[k], y);
+			}
+			nl = j;
+		}			
+	}
+}
+
+/* everything that depends on the grid density */
+typedef struct irls_grid {
+	size_t len;
+	double *W, *D, *A, *H, *G;
+	size_t *n0;
+	fsrc_dfft dct1, dct, idct;
+} irls_grid;
+
+static void irls_grid_free(irls_grid *gr)
+{
+	if(gr->dct != gr->dct1) {
+		if(gr->dct) fsrc_dfft_destroy(gr->dct);
+		if(gr->idct) fsrc_dfft_destroy(gr->idct);
+	}
+
+	if(gr->dct1) fsrc_dfft_destroy(gr->dct1);
+
+	free(gr->n0);
+
+	fsrc_free(gr->G);
+	fsrc_free(gr->H);
+	fsrc_free(gr->A);
+	fsrc_free(gr->D);
+	fsrc_free(gr->W);
+}
+
+static int irls_grid_init(irls_grid *gr, size_t grid_len, size_t n, size_t m, const double *f, const double *a, const double *w)
 {
 	fsrc_err err;
+
+	memset(gr, 0, sizeof(irls_grid));
+	gr->len = grid_len;
+
+	/* L2 weights */
+	gr->W = (double*)fsrc_alloc(grid_len * sizeof(double));
+	if(!gr->W) goto cleanup;
+	/* Chebyshev weights */
+	gr->D = (double*)fsrc_alloc(grid_len * sizeof(double));
+	if(!gr->D) goto cleanup;
+	/* Desired response */
+	gr->A = (double*)fsrc_alloc(grid_len * sizeof(double));
+	if(!gr->A) goto cleanup;
+	/* G, H: general purpose buffers */
+	gr->H = (double*)fsrc_alloc(grid_len * sizeof(double));
+	if(!gr->H) goto cleanup;
+	gr->G = (double*)fsrc_alloc(grid_len * sizeof(double));
+	if(!gr->G) goto cleanup;
+
+	 /* band edge indices */
+	size_t *n0 = gr->n0 = (size_t*)malloc(2 * m * sizeof(size_t));
+	if(!n0) goto cleanup;
+
+	err = fsrc_ddtt_init(&gr->dct1, grid_len, gr->A, gr->H, FSRC_DCT_1, 0);
+	if(err != FSRC_S_OK) goto cleanup;
+	if(n & 1) {
+		gr->dct = gr->dct1;
+		gr->idct = gr->dct1;
+	} else {
+		err = fsrc_ddtt_init(&gr->dct, grid_len - 1, gr->A, gr->H, FSRC_DCT_2, 0);
+		if(err != FSRC_S_OK) goto cleanup;
+		err = fsrc_ddtt_init(&gr->idct, grid_len - 1, gr->H, gr->A, FSRC_DCT_3, 0);
+		if(err != FSRC_S_OK) goto cleanup;
+	}
+
+	/* compute band edge indices */
+	n0[0] = 0;
+	for (size_t i = 1; i < 2 * m - 1; i += 2)
+		n0[i] = (size_t)ceil(f[i - 1] * (grid_len - 1));
+	for (size_t i = 2; i < 2 * m - 1; i += 2)
+		n0[i] = (size_t)floor(f[i - 1] * (grid_len - 1));
+	n0[2 * m - 1] = grid_len;
+
+	memset(gr->W, 0, grid_len * sizeof(double));
+	memset(gr->D, 0, grid_len * sizeof(double));
+	memset(gr->A, 0, grid_len * sizeof(double));
+
+	/*wmax = w[cblas_idamax(m, w, 1)];*/
+	for(size_t i = 0; i < m; ++i) {
+		size_t nl = n0[2 * i];
+		size_t nr = n0[2 * i + 1];
+		double wi = w[i]; /*/ wmax;*/
+		double w2 = wi * wi;
+		for(size_t j = nl; j < nr; ++j) {
+			gr->D[j] = wi;
+			gr->W[j] = w2;
+			gr->A[j] = a[i];
+		}
+	}
+
+	return 1;
+
+cleanup:
+	irls_grid_free(gr);
+	return 0;
+}
+
+int fir_irls(const fir_irls_spec *spec, fir_irls_info *inf)
+{
 	toep_pcg *pcg;
+	irls_grid gr, gn;
 	fsrc_dfft dct1, dct, idct;
 	double irls_tol, pcg_tol;
 	double *h, *W, *D, *A, *H, *G, *g, *ev, *gev, *kern;/*, wmax;*/
 	const double *f, *a, *w;	
-	size_t n, m, gev_size, ev_size, *n0 = 0;
+	size_t n, m, gev_size, ev_size, *n0;
 
 	n = spec->n;
 	h = spec->h;
@@ -57,38 +238,29 @@ int fir_irls(const fir_irls_spec *spec, fir_irls_info *inf)
 	unsigned cgi = 0; /* pcg iterations */
 
 	size_t l = (n + 1) / 2; /* number of unique coefficients */
-	size_t grid_len = nextpow2(IRLS_GRID_DENS * n) + 1;
-	double s = 1.0 / (2 * (grid_len - 1)); /* fft scale */
+	size_t grid_max = nextpow2(IRLS_GRID_DENS * n) + 1;
+	size_t grid_len = grid_max;
+
+	/* previous weights are already shaped for the final grid */
+	int wload = spec->w0 && spec->nw0 > 1;
+	if(!wload)
+		grid_len = MIN(nextpow2(IRLS_COARSE_DENS * n) + 1, grid_max);
 
 	pcg = 0;
-	dct1 = dct = idct = 0;
-	W = D = A = H = G = g = ev = gev = kern = 0;
+	g = ev = gev = kern = 0;
 
-	/* L2 weights */
-	W = (double*)fsrc_alloc(grid_len * sizeof(double));
-	if(!W) goto cleanup;
-	/* Chebyshev weights */
-	D = (double*)fsrc_alloc(grid_len * sizeof(double));
-	if(!D) goto cleanup;
-	/* Desired response */
-	A = (double*)fsrc_alloc(grid_len * sizeof(double));
-	if(!A) goto cleanup;
-	/* G, H: general purpose buffers */
-	H = (double*)fsrc_alloc(grid_len * sizeof(double));
-	if(!H) goto cleanup;
-	G = (double*)fsrc_alloc(grid_len * sizeof(double));
-	if(!G) goto cleanup;
+	if(!irls_grid_init(&gr, grid_len, n, m, f, a, w)) {
+		memset(&gr, 0, sizeof(irls_grid));
+		goto cleanup;
+	}
 
 	/* previous coefficients */
 	g = (double*)fsrc_alloc(n * sizeof(double));
 	if(!g) goto cleanup;
 
-	 /* band edge indices */
-	n0 = (size_t*)malloc(2 * m * sizeof(size_t));
-	if(!n0) goto cleanup;
-
-	pcg = toep_pcg_init(n, opt);
-	if(!n0) goto cleanup;
+	/* each solve starts from the previous solution */
+	pcg = toep_pcg_init(n, opt | PCG_TOEP_OPT_X0);
+	if(!pcg) goto cleanup;
 
 	gev_size = toep_pcg_circulant_size(pcg);
 	ev_size = toep_pcg_precond_size(pcg);
@@ -100,45 +272,36 @@ int fir_irls(const fir_irls_spec *spec, fir_irls_info *inf)
 
 	kern = toep_pcg_jackson(pcg, 3);
 	if(!kern) goto cleanup;
-	
-	err = fsrc_ddtt_init(&dct1, grid_len, A, H, FSRC_DCT_1, 0);
-	if(err != FSRC_S_OK) goto cleanup;
-	if(n & 1) {
-		dct = dct1;
-		idct = dct1;
-	} else {
-		err = fsrc_ddtt_init(&dct, grid_len - 1, A, H, FSRC_DCT_2, 0);
-		if(err != FSRC_S_OK) goto cleanup;
-		err = fsrc_ddtt_init(&idct, grid_len - 1, H, A, FSRC_DCT_3, 0);
-		if(err != FSRC_S_OK) goto cleanup;
-	}
 
-	/* compute band edge indices */
-	n0[0] = 0;
-	for (size_t i = 1; i < 2 * m - 1; i += 2)
-		n0[i] = (size_t)ceil(f[i - 1] * (grid_len - 1));
-	for (size_t i = 2; i < 2 * m - 1; i += 2)
-		n0[i] = (size_t)floor(f[i - 1] * (grid_len - 1));
-	n0[2 * m - 1] = grid_len;
+	W = gr.W; D = gr.D; A = gr.A; H = gr.H; G = gr.G;
+	n0 = gr.n0;
+	dct1 = gr.dct1; dct = gr.dct; idct = gr.idct;
+	double s = 1.0 / (2 * (grid_len - 1)); /* fft scale */
 
-	memset(W, 0, grid_len * sizeof(double));
-	memset(D, 0, grid_len * sizeof(double));
-	memset(A, 0, grid_len * sizeof(double));
+	memset(h, 0, n * sizeof(double));
 
-	/*wmax = w[cblas_idamax(m, w, 1)];*/
-	for(size_t i = 0; i < m; ++i) {
-		size_t nl = n0[2 * i];
-		size_t nr = n0[2 * i + 1];
-		double wi = w[i]; /*/ wmax;*/
-		double w2 = wi * wi;
-		for(size_t j = nl; j < nr; ++j) {
-			D[j] = wi;
-			W[j] = w2;
-			A[j] = a[i];
-		}
+	int warm = spec->h0 && spec->n0 && (spec->n0 & 1) == (n & 1);
+	if(warm) {
+		memcpy(h, spec->h0, MIN((spec->n0 + 1) / 2, l) * sizeof(double));
+		fsrc_dcopy(n - l, h + 2 * l - n, 1, h + l, -1);
 	}
 
-	memset(h, 0, n * sizeof(double));
+	memset(G, 0, grid_len * sizeof(double));
+	if(wload && irls_load_weights(G, grid_len, n0, m, spec->w0, spec->nw0)) {
+		/* the previous weights already carry the envelope */
+		memcpy(W, G, grid_len * sizeof(double));
+	} else if(warm) {
+		/* pretend h0 is the result of the first iteration */
+		memcpy(G, h, l * sizeof(double));
+		memset(G + l, 0, (grid_len - l) * sizeof(double));
+		fsrc_ddtt(dct, G, H);
+		irls_envelope(H, D, A, n0, m, grid_len);
+		for(size_t j = 0; j < grid_len; ++j)
+			W[j] *= H[j];
+	}
+
+	int coarse = !wload;
+
 	for(;;) {
 		memcpy(g, h, n * sizeof(double));
 
@@ -163,7 +326,8 @@ int fir_irls(const fir_irls_spec *spec, fir_irls_info *inf)
 
 		++ni;
 
-		unsigned ncg = toep_pcg_solve(pcg, gev, ev, G, h, pcg_tol, IRLS_MAX_PCG_ITER);
+		double tol = coarse ? MAX(pcg_tol, IRLS_COARSE_PCG_TOL) : pcg_tol;
+		unsigned ncg = toep_pcg_solve(pcg, gev, ev, G, h, tol, IRLS_MAX_PCG_ITER);
 		cgi += ncg;
 		if(ncg == IRLS_MAX_PCG_ITER) {
 			ni = -ni;
@@ -177,7 +341,8 @@ int fir_irls(const fir_irls_spec *spec, fir_irls_info *inf)
 
 		/* check stop condition */
 		fsrc_dxmy(n, h, g);
-		if(fsrc_dnrm2(n, g) / fsrc_dnrm2(n, h) < irls_tol)
+		double dh = fsrc_dnrm2(n, g) / fsrc_dnrm2(n, h);
+		if(dh < irls_tol && !coarse)
 			break;
 
 		if(ni == IRLS_MAX_ITER) {
@@ -185,33 +350,37 @@ int fir_irls(const fir_irls_spec *spec, fir_irls_info *inf)
 			break;
 		}
 
-		/* compute the error envelope */
-		for(size_t j = 0; j < grid_len; ++j)
-			H[j] = pow(D[j] * fabs(H[j] - A[j]), IRLS_ALPHA);
-
-		for(size_t i = 0; i < m; ++i) {
-			size_t nl = n0[2 * i];
-			size_t nr = n0[2 * i + 1];
-
-			while (nl < nr - 1) {
-				// find the next peak
-				size_t j = nl + 1;
-				while(j < nr - 1 && (H[j - 1] > H[j] || H[j] < H[j + 1]))
-					++j;
-				// perform linear interpolation
-				double a = (H[j] - H[nl]) / (j - nl);
-				double c = H[nl] - a * nl;
-				for(size_t k = nl; k < j; ++k) {
-					double y = a * k + c;
-					H[k] = MAX(H[k], y);
-				}
-				nl = j;
-			}			
-		}
+		irls_envelope(H, D, A, n0, m, grid_len);
 
 		/* update weights */
 		for(size_t j = 0; j < grid_len; ++j)
 			W[j] *= H[j];
+
+		if(coarse && dh < IRLS_REFINE_TOL) {
+			/* move on to the final grid and exact solves, keeping the weights */
+			coarse = 0;
+			if(grid_len < grid_max) {
+				size_t len = grid_max;
+				if(!irls_grid_init(&gn, len, n, m, f, a, w)) {
+					ni = 0;
+					break;
+				}
+
+				/* the band edges may have moved. if the weights don't fit, start over */
+				memset(gn.G, 0, len * sizeof(double));
+				if(irls_load_weights(gn.G, len, gn.n0, m, W, grid_len))
+					memcpy(gn.W, gn.G, len * sizeof(double));
+
+				irls_grid_free(&gr);
+				gr = gn;
+				grid_len = len;
+
+				W = gr.W; D = gr.D; A = gr.A; H = gr.H; G = gr.G;
+				n0 = gr.n0;
+				dct1 = gr.dct1; dct = gr.dct; idct = gr.idct;
+				s = 1.0 / (2 * (grid_len - 1));
+			}
+		}
 	}
 
 	double del = 0;
@@ -226,29 +395,25 @@ int fir_irls(const fir_irls_spec *spec, fir_irls_info *inf)
 	inf->niter = ni;
 	inf->npcg = cgi;
 	inf->del = del;
+	inf->nw = 0;
+	inf->w = 0;
+
+	if(ni > 0 && (spec->flags & FIR_IRLS_KEEP_WEIGHTS)) {
+		inf->nw = grid_len;
+		inf->w = W;
+		gr.W = 0;
+	}
 
 cleanup:
 
-	if(!(n & 1)) {
-		if(dct) fsrc_dfft_destroy(dct);
-		if(idct) fsrc_dfft_destroy(idct);
-	}
+	irls_grid_free(&gr);
 
-	if(dct1) fsrc_dfft_destroy(dct1);
 	if(pcg) toep_pcg_destroy(pcg);
 
-	free(n0);
-
 	fsrc_free(kern);
 	fsrc_free(ev);
 	fsrc_free(gev);
 	fsrc_free(g);
-	fsrc_free(G);
-	fsrc_free(H);
-	fsrc_free(A);
-	fsrc_free(D);
-	fsrc_free(W);
 
 	return ni;
 }
-
@@ -32,12 +32,26 @@ typedef struct fir_irls_spec {
 
 	double irls_tol;
 	double pcg_tol;	
+
+	/* optional warm start. either one may be left out */
+	size_t n0;
+	const double *h0;	/* initial guess, unique coefficients only (center tap first) */
+	size_t nw0;
+	const double *w0;	/* initial weights, sampled uniformly over [0, 1] */
+
+	int flags;
 } fir_irls_spec;
 
+/* return the final weights in fir_irls_info. free them with fsrc_free */
+#define FIR_IRLS_KEEP_WEIGHTS	0x01
+
 typedef struct fir_irls_info {
 	double del;
 	int niter;
 	int npcg;	
+
+	size_t nw;
+	double *w;
 } fir_irls_info;
 
 int fir_irls(const fir_irls_spec *spec, fir_irls_info *info);
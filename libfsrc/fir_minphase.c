@@ -21,35 +21,22 @@
 #include "fft.h"
 #include "xblas.h"
 #include "bits.h"
+#include "lpf_design.h"
 #include <math.h>
 #include <string.h>
 #include <assert.h>
 
-#define FSRC_LN_3	1.09861228866810969139525
-#define FSRC_ILN_3	0.910239226626837393614240
-
-static size_t nextpow3(size_t N)
-{
-	size_t L = (size_t)(exp(ceil(log((double)N) * FSRC_ILN_3) * FSRC_LN_3) + .5);
-	assert(L % 3 == 0);
-	return L;
-}
-
-/*
-	Turns an arbitrary filter into a minimum-phase version
-	The resulting minimum phase filter is suboptimal for a given length
+/* 
+	cepstral minimum phase conversion with an fft of size L.
+	e receives the largest magnitude response error of g on that grid,
+	relative to the ripple of the band it falls into
 */
-fsrc_err fsrc_fir_minphase(size_t N, const double *h, double *g)
+static fsrc_err fsrc_fir_minphase_fft(size_t L, size_t N, const double *h, double *g, const fsrc_lps *lps, double *e)
 {
-	size_t L = 64 * N; /* accuracy depends on the fft size */
-	if(N & 1)
-		L = nextpow2(L);
-	else /* the nyquist frequency bin is always zero for even length filters */
-		L = nextpow3(L); /* using an odd-length fft avoids the problem */
-
 	size_t K = L / 2 + 1;
 
 	double *x = 0;
+	double *A = 0;
 	fsrc_dcomplex *X = 0;
 	fsrc_dfft fft = 0;
 	fsrc_dfft ifft = 0;
@@ -58,6 +45,8 @@ fsrc_err fsrc_fir_minphase(size_t N, const double *h, double *g)
 
 	x = (double*)fsrc_alloc(L * sizeof(double));	
 	if(!x) goto cleanup;
+	A = (double*)fsrc_alloc(K * sizeof(double));	
+	if(!A) goto cleanup;
 	X = (fsrc_dcomplex*)fsrc_alloc(K * sizeof(fsrc_dcomplex));
 	if(!X) goto cleanup;
 
@@ -72,9 +61,9 @@ fsrc_err fsrc_fir_minphase(size_t N, const double *h, double *g)
 	fsrc_drcdft(fft, x, X);
 
 	for(size_t i = 0; i < K; ++i) {
-		double A = X[i][0] * X[i][0] + X[i][1] * X[i][1];
-		assert(A > 0);
-		X[i][0] = .5 * log(A) / L;
+		A[i] = X[i][0] * X[i][0] + X[i][1] * X[i][1];
+		assert(A[i] > 0);
+		X[i][0] = .5 * log(A[i]) / L;
 		X[i][1] = 0;
 	}
 
@@ -97,6 +86,26 @@ fsrc_err fsrc_fir_minphase(size_t N, const double *h, double *g)
 
 	memcpy(g, x, N * sizeof(double));
 
+	/* the cepstrum is aliased, so the truncated result doesn't quite have the magnitude of h */
+	memset(x + N, 0, (L - N) * sizeof(double));
+	fsrc_drcdft(fft, x, X);
+
+	*e = 0;
+	for(size_t i = 0; i < K; ++i) {
+		double f = 2.0 * i / L;
+		double r;
+		if(f <= lps->fp)
+			r = lps->dp;
+		else if(f >= lps->fs)
+			r = lps->ds;
+		else
+			continue;
+
+		double d = fabs(sqrt(X[i][0] * X[i][0] + X[i][1] * X[i][1]) - sqrt(A[i])) / r;
+		if(d > *e)
+			*e = d;
+	}
+
 	err = FSRC_S_OK;
 	
 cleanup:
@@ -104,6 +113,54 @@ cleanup:
 	if(ifft) fsrc_dfft_destroy(ifft);
 
 	fsrc_free(X);
+	fsrc_free(A);
+	fsrc_free(x);
+
+	return err;
+}
+
+/* the fft size starts at MINPHASE_MIN_OVS * N and is doubled up to MINPHASE_MAX_OVS * N */
+#define MINPHASE_MIN_OVS 16
+#define MINPHASE_MAX_OVS 256
+
+/*
+	Turns a low-pass into a minimum-phase version
+	The resulting minimum phase filter is suboptimal for a given length
+
+	The accuracy depends on the fft size, which is doubled until the 
+	magnitude response in the pass and stop bands is within tol times 
+	the respective ripple of the original. if it isn't at the largest 
+	size, that's FSRC_E_CONVERGENCE, so it doesn't get cached as meeting 
+	the spec.
+*/
+fsrc_err fsrc_fir_minphase(size_t N, const double *h, double *g, const fsrc_lps *lps, double tol)
+{
+	/* the nyquist frequency bin is always zero for even length filters */
+	int eo = (N & 1) ? FSRC_FFT_SIZE_ANY : FSRC_FFT_SIZE_ODD; /* an odd-length fft avoids the problem */
+
+	/* h may alias g */
+	double *x = (double*)fsrc_alloc(N * sizeof(double));
+	if(!x)
+		return FSRC_E_NOMEM;
+
+	memcpy(x, h, N * sizeof(double));
+
+	fsrc_err err;
+	size_t L = fsrc_fft_opt_size_high(MINPHASE_MIN_OVS * N, eo);
+	for(;;) {
+		double e;
+		err = fsrc_fir_minphase_fft(L, N, x, g, lps, &e);
+		if(err != FSRC_S_OK || e <= tol)
+			break;
+
+		if(L >= MINPHASE_MAX_OVS * N) {
+			err = FSRC_E_CONVERGENCE;
+			break;
+		}
+
+		L = fsrc_fft_opt_size_high(2 * L, eo);
+	}
+
 	fsrc_free(x);
 
 	return err;
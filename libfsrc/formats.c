@@ -75,3 +75,106 @@
 
 #include "formats_inst.h"
 
+/* integer <-> integer, for the fixed point stages, see FSRC_FIXED */
+
+#define DECL (void)0
+#define EXPR(src, dst) (dst) = (int16_t)(((int)(src) + INT8_MIN) * 256)
+#define SN ui8
+#define ST uint8_t
+#define DN i16
+#define DT int16_t
+#include "formats_impl.h"
+
+#define DECL (void)0
+#define EXPR(src, dst) (dst) = (int32_t)(((int)(src) + INT8_MIN) * 16777216)
+#define SN ui8
+#define ST uint8_t
+#define DN i32
+#define DT int32_t
+#include "formats_impl.h"
+
+#define DECL (void)0
+#define EXPR(src, dst) (dst) = (uint8_t)(((src) >> 8) - INT8_MIN)
+#define SN i16
+#define ST int16_t
+#define DN ui8
+#define DT uint8_t
+#include "formats_impl.h"
+
+#define DECL (void)0
+#define EXPR(src, dst) (dst) = (uint8_t)(((src) >> 24) - INT8_MIN)
+#define SN i32
+#define ST int32_t
+#define DN ui8
+#define DT uint8_t
+#include "formats_impl.h"
+
+#define DECL (void)0
+#define EXPR(src, dst) (dst) = (src)
+#define SN i16
+#define ST int16_t
+#define DN i16
+#define DT int16_t
+#include "formats_impl.h"
+
+#define DECL (void)0
+#define EXPR(src, dst) (dst) = (src)
+#define SN i32
+#define ST int32_t
+#define DN i32
+#define DT int32_t
+#include "formats_impl.h"
+
+#define DECL (void)0
+#define EXPR(src, dst) (dst) = (int32_t)(src) * 65536
+#define SN i16
+#define ST int16_t
+#define DN i32
+#define DT int32_t
+#include "formats_impl.h"
+
+#define DECL (void)0
+#define EXPR(src, dst) (dst) = (int16_t)((src) >> 16)
+#define SN i32
+#define ST int32_t
+#define DN i16
+#define DT int16_t
+#include "formats_impl.h"
+
+#define Y(n, sf, df) Y_(n, sf, df)
+#define ROW(sf, df) { Y(1, sf, df), Y(2, sf, df), Y(4, sf, df), Y(6, sf, df), Y(8, sf, df) }
+
+const fsrc_cvt_t fsrc_cvt_xw[][5] = {
+	ROW(ui8, i16),
+	ROW(i16, i16),
+	ROW(i32, i16),
+	ROW(f32, i16),
+	ROW(f64, i16),
+};
+
+const fsrc_cvt_t fsrc_cvt_wx[][5] = {
+	ROW(i16, ui8),
+	ROW(i16, i16),
+	ROW(i16, i32),
+	ROW(i16, f32),
+	ROW(i16, f64),
+};
+
+const fsrc_cvt_t fsrc_cvt_xl[][5] = {
+	ROW(ui8, i32),
+	ROW(i16, i32),
+	ROW(i32, i32),
+	ROW(f32, i32),
+	ROW(f64, i32),
+};
+
+const fsrc_cvt_t fsrc_cvt_lx[][5] = {
+	ROW(i32, ui8),
+	ROW(i32, i16),
+	ROW(i32, i32),
+	ROW(i32, f32),
+	ROW(i32, f64),
+};
+
+#undef ROW
+#undef Y
@@ -29,6 +29,13 @@ extern const fsrc_cvt_t fsrc_cvt_xs[][5];
 extern const fsrc_cvt_t fsrc_cvt_dx[][5];
 extern const fsrc_cvt_t fsrc_cvt_sx[][5];
 
+/* to and from the fixed point stages' 16 and 32 bit samples */
+extern const fsrc_cvt_t fsrc_cvt_xw[][5];
+extern const fsrc_cvt_t fsrc_cvt_wx[][5];
+
+extern const fsrc_cvt_t fsrc_cvt_xl[][5];
+extern const fsrc_cvt_t fsrc_cvt_lx[][5];
+
 typedef const fsrc_cvt_t (*fsrc_cvt_tbl_t)[5];
 
 typedef enum fsrc_cvt {
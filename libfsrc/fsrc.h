@@ -167,29 +167,91 @@ struct fsrc_ioi {
 	void (*unlock)(intptr_t file);
 };
 
+/*
+	optional extensions, see fsrc_cache_create_ioi_ex. they're kept out of 
+	fsrc_ioi, so implementations built against its original layout still 
+	work. set size to sizeof(fsrc_ioi_ext), members it doesn't cover are 
+	taken as null, as are the ones that are null
+*/
+typedef struct fsrc_ioi_ext {
+	size_t size;
+
+	/*
+		with all three present, lookups read a read-only mapping of the 
+		cache without taking the lock, and writers publish a new index by 
+		renaming it over the old one.
+	*/
+	const void *(*map)(intptr_t file, fsrc_off size); /* null on failure */
+	void (*unmap)(const void *ptr, fsrc_off size);
+	int (*rename)(const fsrc_ioi **pioi, const char *from, const char *to); /* atomic, replaces to */
+
+	/* nonzero if both are the same file, see fsrc_cache_import */
+	int (*same)(intptr_t a, intptr_t b);
+} fsrc_ioi_ext;
+
 typedef struct fsrc_cache fsrc_cache;
 
 /*
 	initialize the design cache. speeds up converter creation,
 	especially at high qualities
 
-	implemented using fsrc_cache_create_ioi
+	a filter designed to a stricter spec than the one asked for is used 
+	when it's not much longer than a design to that spec would be, so 
+	what's already cached can make a difference to the filters used
+
+	implemented using fsrc_cache_create_ioi_ex
 
 	mode (access mode applied to created files) is ignored on Windows
 	rw - read/write (nonzero) or read only mode
+
+	a cache object can be used from several threads at once
 */
 FSRC_API fsrc_err fsrc_cache_create_dir(fsrc_cache **cache, const char *path, int mode, int rw);
 
 FSRC_API fsrc_err fsrc_cache_create_ioi(fsrc_cache **cache, const fsrc_ioi **ioi, int rw);
 
+/* the same, with the extensions in ext, which can be null. it's copied */
+FSRC_API fsrc_err fsrc_cache_create_ioi_ex(fsrc_cache **cache, const fsrc_ioi **ioi, const fsrc_ioi_ext *ext, int rw);
+
 /* clear any cached designs */
 FSRC_API fsrc_err fsrc_cache_clear(fsrc_cache *cache);
 
+/*
+	reclaim the space taken up by dead entries. done automatically as
+	designs are added, once there's enough of it
+*/
+FSRC_API fsrc_err fsrc_cache_compact(fsrc_cache *cache);
+
+/*
+	caps what the cache takes up on disk, in bytes, 0 for no limit. once 
+	adding designs would take it past that, the ones used least recently 
+	are evicted until it's down to about three quarters of it. the limit 
+	is kept in the cache itself, so it applies to everyone using it
+*/
+FSRC_API fsrc_err fsrc_cache_set_limit(fsrc_cache *cache, fsrc_ull bytes);
+
+typedef struct fsrc_stats {
+	fsrc_ull hits;		/* designs found by this cache object */
+	fsrc_ull misses;	/* and not found */
+	double saved;		/* seconds it took to make the ones found, originally */
+	fsrc_ull entries;	/* designs in the cache */
+	fsrc_ull bytes;		/* what the cache files take up */
+	fsrc_ull live;		/* what the designs in it need, the rest is reclaimable */
+	fsrc_ull limit;		/* see fsrc_cache_set_limit */
+} fsrc_stats;
+
+/* 
+	usage statistics. the counters are kept since the cache object was 
+	created, the rest describes the cache as it is now
+*/
+FSRC_API fsrc_err fsrc_cache_stats(fsrc_cache *cache, fsrc_stats *stats);
+
 /* frees the cache object */
 FSRC_API void fsrc_cache_destroy(fsrc_cache *cache);
 
  /*
- 	merge the contents of the source cache into destination cache
+ 	merge the contents of the source cache into destination cache.
+ 	a no-op when both name the same directory
 */
 FSRC_API fsrc_err fsrc_cache_import(fsrc_cache *dst, fsrc_cache *src);
 
@@ -207,6 +269,38 @@ FSRC_API fsrc_err fsrc_cache_import(fsrc_cache *dst, fsrc_cache *src);
 /* use double precision */
 #define FSRC_DOUBLE			0x04
 
+/* 
+	also cache the tables the stages derive from the filters, so a warm 
+	fsrc_create just maps them in. they can be a lot larger than the filters
+*/
+#define FSRC_CACHE_TABLES	0x08
+
+/*
+	store new filters in the cache as floats, when the ripple allowed leaves
+	room for the rounding. roughly halves the cache, but the filters read
+	back aren't exactly the ones designed
+*/
+#define FSRC_CACHE_FLOATS	0x10
+
+/*
+	use fixed point stages, with the samples kept as 16 or 32 bit integers, 
+	so integer input and output needs no conversion to speak of. the 16 bit 
+	stages round the coefs to 14 bits, which is good for about 80 dB, so 
+	they're used when ds is at least FSRC_FIXED16_DS, and FSRC_DOUBLE isn't 
+	set. FSRC_USE_FFT is ignored
+*/
+#define FSRC_FIXED			0x20
+#define FSRC_FIXED16_DS		1e-4
+
+/*
+	keep the samples and coefs as floats, as without FSRC_DOUBLE, but sum 
+	the products in double precision in the stages whose phases are long 
+	enough for float sums to round off more than ds allows. the others 
+	stay float throughout. FSRC_DOUBLE and FSRC_FIXED take precedence, and 
+	the FSRC_USE_FFT stages aren't affected, they have no long sums
+*/
+#define FSRC_MIXED			0x40
+
 typedef struct fsrc_spec {
 	int version;		/* set to 0 */
 	
@@ -241,6 +335,15 @@ FSRC_API void fsrc_load_preset(fsrc_ratio fr, fsrc_preset pre, fsrc_spec *spec);
 /* designs the converter and caches the design for later use */
 FSRC_API fsrc_err fsrc_cache_design(fsrc_cache *cache, fsrc_spec *spec);
 
+/*
+	designs and caches n specs at once. the filters missing from the cache 
+	are designed in parallel, each distinct one only once, and stored in 
+	a single transaction. with FSRC_CACHE_TABLES, the stage tables are 
+	cached too, which needs isize and osize set like for fsrc_create.
+	errs is optional and gets each spec's result. returns the first failure
+*/
+FSRC_API fsrc_err fsrc_cache_design_batch(fsrc_cache *cache, const fsrc_spec *specs, size_t n, fsrc_err *errs);
+
 typedef struct fsrc_converter fsrc_converter;
 
 /*
@@ -248,6 +351,56 @@ typedef struct fsrc_converter fsrc_converter;
 */
 FSRC_API fsrc_err fsrc_create(fsrc_cache *cache, fsrc_converter **src, fsrc_spec *spec, size_t chans);
 
+/* alloc has to return 16 byte aligned memory, like fsrc_alloc */
+typedef struct fsrc_allocator {
+	void *(*alloc)(size_t size, void *arg);
+	void (*free)(void *p, void *arg);
+	void *arg;
+} fsrc_allocator;
+
+/*
+	fsrc_create, with the converter's memory from alloc, which is copied 
+	and used until fsrc_destroy. it's 0 for fsrc_alloc. with 
+	FSRC_CREATE_ARENA, the buffers and stages are carved from one block, 
+	sized up front from the design, and freed together. the pieces are 
+	cache line aligned. where that block goes (huge pages, a NUMA node) is 
+	up to alloc.
+
+	the shared tables aren't the converter's, see FSRC_CACHE_TABLES, and 
+	neither are fftw's plans, fftw allocates them itself
+*/
+#define FSRC_CREATE_ARENA	0x01
+
+FSRC_API fsrc_err fsrc_create_ex(fsrc_cache *cache, fsrc_converter **src, fsrc_spec *spec, size_t chans, 
+	const fsrc_allocator *alloc, int flags);
+
+/* called once the final design is ready, or failed. see below */
+typedef void (*fsrc_async_proc)(fsrc_converter *src, fsrc_err err, void *arg);
+
+/*
+	like fsrc_create, but doesn't wait for filters that aren't cached to 
+	be designed. until they are, in the background, the converter runs 
+	on quick windowed stand-ins that are longer and only roughly to spec. 
+	fsrc_process then swaps the final design in between two calls, the 
+	buffered samples carry over. the stand-ins are made longer than the 
+	final filters are expected to be, and those are zero padded to the 
+	stand-ins' length, so the latency stays the same at the cost of some 
+	wasted work. with FSRC_LPF_MINPHASE it changes a lot, since the 
+	stand-ins are linear phase.
+
+	proc is optional. it's called from the design thread (or right away, 
+	if everything was cached) once the next fsrc_process can swap the 
+	final design in, and mustn't call into the converter. if the design fails, the stand-ins stay. the stand-in 
+	converter is freed by fsrc_async_wait or fsrc_destroy, not by 
+	fsrc_process or fsrc_reset. fsrc_destroy waits for the design to finish.
+	the cache is used from the design thread
+*/
+FSRC_API fsrc_err fsrc_create_async(fsrc_cache *cache, fsrc_converter **src, fsrc_spec *spec, size_t chans, 
+	fsrc_async_proc proc, void *arg);
+
+/* waits for the final design and swaps it in. returns how the design went */
+FSRC_API fsrc_err fsrc_async_wait(fsrc_converter *src);
+
 FSRC_API void fsrc_destroy(fsrc_converter *src);
 
 FSRC_API fsrc_ratio fsrc_get_ratio(fsrc_converter *src); 
@@ -302,9 +455,69 @@ FSRC_API size_t fsrc_write(fsrc_converter *src, const fsrc_bufdesc *desc);
 */
 FSRC_API size_t fsrc_write_split(fsrc_converter *src, size_t size, const fsrc_chandesc *desc);
 
-/* do actual processing */
+/* 
+	do actual processing. every stage runs as far as it can, one that's 
+	starved or full doesn't stop the ones after it, so a single call 
+	drains what's buffered in between. the result is the last stage's: 
+	FSRC_S_OK if it made output, FSRC_S_BUFFER_EMPTY if it needs more 
+	input, FSRC_S_BUFFER_FULL if the output has to be written out first. 
+	the earlier stages' status isn't reported. FSRC_S_END once everything 
+	after fsrc_end has been written
+*/
 FSRC_API fsrc_err fsrc_process(fsrc_converter *src);
 
+/*
+	fsrc_read, fsrc_process and fsrc_write in one go. fsrc_push takes as 
+	many of the samples as it can, processing to make room. that stops once 
+	the output is full, so pull some and push the rest. fsrc_pull processes 
+	until it has desc->size samples, or the input runs out, and returns 
+	how many it wrote. after fsrc_end, it returns less than asked for at 
+	the end of the stream.
+
+	fsrc_write can be called with any size, what it leaves is still there 
+	for the next one
+*/
+FSRC_API size_t fsrc_push(fsrc_converter *src, const fsrc_bufdesc *desc);
+FSRC_API size_t fsrc_pull(fsrc_converter *src, const fsrc_bufdesc *desc);
+
+/*
+	an input callback for fsrc_pull, instead of pushing. when fsrc_pull runs 
+	out of input, it asks for the samples the rest of its output takes, or 
+	as many as fit, if that's less. the callback passes them in with 
+	fsrc_read or fsrc_read_split, and returns how many it read, which can 
+	be fewer. returning 0 ends the stream, as fsrc_end does.
+
+	fsrc_pull doesn't allocate or wait on locks, so it can be called from an 
+	audio device's callback, as long as the input callback doesn't either
+*/
+typedef size_t (*fsrc_input_proc)(fsrc_converter *src, size_t size, void *arg);
+
+/* proc can be 0, to go back to fsrc_push */
+FSRC_API void fsrc_set_input(fsrc_converter *src, fsrc_input_proc proc, void *arg);
+
+/*
+	real-time use. once the converter is created, fsrc_read, fsrc_write 
+	(and the _split ones), fsrc_process, fsrc_push, fsrc_pull, fsrc_reset 
+	and fsrc_end don't allocate, make system calls or wait on locks. an 
+	async converter only tries the lock the final design is handed over 
+	with. with FSRC_USE_FFT, it's down to fftw's execute functions, and 
+	some plans take scratch memory there.
+
+	what's left is page faults. tables mapped from the cache are only read 
+	in as they're used, an async converter's final design is new memory, 
+	and anything can be paged out while idle. fsrc_prepare faults it all 
+	in, and with FSRC_PREPARE_LOCK also locks it in memory until 
+	fsrc_destroy. the final design gets the same once it's done. the 
+	library's code and fftw's plans aren't covered, mlockall does that.
+
+	the locking limit is usually low (RLIMIT_MEMLOCK, the working set size), 
+	FSRC_E_NORSRC if it's hit, and nothing stays locked. fsrc_prepare 
+	isn't real-time itself, call it before starting
+*/
+#define FSRC_PREPARE_LOCK	0x01
+
+FSRC_API fsrc_err fsrc_prepare(fsrc_converter *src, int flags);
+
 EXTERN_C_END
 
 #endif
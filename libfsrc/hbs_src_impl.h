@@ -0,0 +1,283 @@
+/*    
+	Copyright (C) 2009 Szymon Modzelewski
+
+	This file is part of libfsrc.
+
+    libfsrc is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libfsrc is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libfsrc.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/*
+	halfband stages, for a ratio of 2/1 or 1/2. every other tap of the filter 
+	is zero, except for the center one, see FSRC_LPF_HALFBAND. 
+
+	interpolating, one of the two phases is just the center tap, a delayed 
+	copy of the input, and the other one is symmetric. decimating, the center 
+	tap is added to the symmetric sum of the others. the symmetric taps are 
+	summed in pairs, so a quarter of the filter is multiplied.
+
+	the indexing is the same as in pps_src_impl.h, with the zeros left out
+*/
+
+typedef struct X(stage) {
+	const fsrc_stage_vt *vt;
+
+	unsigned up;
+	unsigned dn;
+
+	size_t n; /* kernel lenght */
+
+	unsigned l;	/* start phase */
+
+	REAL *a;	/* the first half of the symmetric taps */
+	size_t na;	/* how many there are in all */
+	size_t t0;	/* the first one's delay, decimating */
+
+	REAL g;		/* the center tap */
+	size_t dc;	/* its delay */
+	unsigned pc;	/* its phase, interpolating */
+
+	fsrc_iobuf *src;
+	fsrc_iobuf *dst;
+	size_t chans;
+
+	fsrc_heap *heap;
+} X(stage);
+
+static void X(destroy)(fsrc_stage *s)
+{
+	X(stage) *hbs = (X(stage)*)s;
+
+	fsrc_heap_free(hbs->heap, hbs->a);
+	fsrc_heap_free(hbs->heap, hbs);
+}
+
+/* the symmetric taps' sum, in ACC. xo is the oldest sample, xn the newest, s apart */
+static ACC X(symdot)(const REAL *RESTRICT a, size_t na, const REAL *RESTRICT xo, const REAL *RESTRICT xn, size_t s)
+{
+	size_t m = na / 2;
+
+	ACC y = 0;
+	for(size_t i = 0; i < m; ++i)
+		y += (ACC)a[i] * ((ACC)xo[i * s] + xn[-(ptrdiff_t)(i * s)]);
+
+	if(na & 1)
+		y += (ACC)a[m] * xo[m * s];
+
+	return y;
+}
+
+static fsrc_err X(process)(fsrc_stage *s)
+{
+	X(stage) *hbs = (X(stage)*)s;
+
+	REAL *RESTRICT sd = (REAL*)hbs->src->data;
+	size_t ss = hbs->src->size;
+	size_t sp = hbs->src->pos;
+	size_t sh = hbs->src->past;
+
+	if(sp <= sh)
+		return FSRC_S_BUFFER_EMPTY;
+
+	REAL *RESTRICT dd = (REAL*)hbs->dst->data;
+	size_t ds = hbs->dst->size;
+	size_t dp = hbs->dst->pos;
+
+	unsigned L = hbs->up;
+	unsigned M = hbs->dn;
+
+	/* 
+		how many output samples can we produce? output j reads up to input 
+		(j * M + l) / L, which has to be there already
+	*/
+	size_t mo = (size_t)((FSRC_DPMUL(sp - sh, L) - hbs->l + M - 1) / M);
+
+	/* how many samples will fit into the output buffer? */
+	size_t ao = ds - dp;
+
+	size_t dn = MIN(mo, ao);
+	if(dn == 0)
+		return FSRC_S_BUFFER_EMPTY;
+
+	fsrc_ull dnM = FSRC_DPMUL(dn, M) + hbs->l;
+	size_t sn = (size_t)(dnM / L); /* input samples used */
+	size_t lr = (size_t)(dnM % L); /* final phase number */
+
+	assert(sn <= sp);
+
+	const REAL *a = hbs->a;
+	size_t na = hbs->na;
+	ptrdiff_t t0 = (ptrdiff_t)hbs->t0;
+	REAL g = hbs->g;
+	ptrdiff_t dc = (ptrdiff_t)hbs->dc;
+	unsigned pc = hbs->pc;
+
+	size_t ch = hbs->chans;
+	do {
+		REAL *RESTRICT x = sd + sh;
+		REAL *RESTRICT y = dd + dp;
+
+		unsigned l = hbs->l;	
+
+		ptrdiff_t k = 0;
+		if(L == 2) {
+			for(size_t j = 0; j < dn; ++j) {
+				if(l == pc)
+					y[j] = g * x[k - dc];
+				else
+					y[j] = (REAL)X(symdot)(a, na, x + k - (ptrdiff_t)(na - 1), x + k, 1);
+
+				k += l;
+				l ^= 1;
+			}
+		} else {
+			for(size_t j = 0; j < dn; ++j) {
+				const REAL *xn = x + k - t0;
+				y[j] = (REAL)((ACC)g * x[k - dc] + X(symdot)(a, na, xn - 2 * (ptrdiff_t)(na - 1), xn, 2));
+				k += 2;
+			}
+		}
+
+		assert((size_t)k == sn && l == lr);
+		memmove(sd, sd + k, (sp - k) * sizeof(REAL));
+
+		sd += ss;
+		dd += ds;
+	} while(--ch);
+
+	hbs->l = (unsigned)lr;
+
+	hbs->src->pos -= sn;
+	hbs->dst->pos += dn;
+
+	return FSRC_S_OK;
+}
+
+static void X(reset)(fsrc_stage *s)
+{
+	X(stage) *hbs = (X(stage)*)s;
+	hbs->l = 0;
+}
+
+static void X(resume)(fsrc_stage *s, const fsrc_stage *from)
+{
+	((X(stage)*)s)->l = ((const X(stage)*)from)->l;
+}
+
+static size_t X(need)(const fsrc_stage *s, size_t n)
+{
+	const X(stage) *hbs = (const X(stage)*)s;
+	if(n == 0)
+		return 0;
+
+	return (size_t)((FSRC_DPMUL(n - 1, hbs->dn) + hbs->l) / hbs->up) + 1;
+}
+
+static size_t X(regions)(const fsrc_stage *s, fsrc_region *r)
+{
+	const X(stage) *hbs = (const X(stage)*)s;
+
+	r[0].p = hbs;
+	r[0].size = sizeof(X(stage));
+	r[0].tab = 0;
+	r[1].p = hbs->a;
+	r[1].size = (hbs->na + 1) / 2 * sizeof(REAL);
+	r[1].tab = 0;
+
+	return 2;
+}
+
+/* the symmetric taps kept of an N tap halfband, see X(create) */
+static size_t X(ntaps)(size_t N)
+{
+	size_t c = (N - 1) / 2;
+	size_t t0 = (c + 1) & 1;
+	return ((N - t0 + 1) / 2 + 1) / 2;
+}
+
+/* what X(create) takes from the heap */
+size_t X(heap)(const fsrc_stage_model *ms, const fsrc_iobuf *src, const fsrc_iobuf *dst)
+{
+	(void)src;
+	(void)dst;
+	return fsrc_heap_need(sizeof(X(stage))) + fsrc_heap_need(X(ntaps)(ms->n) * sizeof(REAL));
+}
+
+fsrc_err X(create)(const fsrc_stage_model *ms, fsrc_stage **s, fsrc_iobuf *src, fsrc_iobuf *dst, size_t chans, fsrc_heap *heap)
+{
+	static const fsrc_stage_vt vt = {
+		X(destroy),
+		X(process),
+		X(reset),
+		X(resume),
+		X(need),
+		X(regions)
+	};
+
+	unsigned L = ms->ratio.up;
+	unsigned M = ms->ratio.dn;
+	size_t N = ms->n;
+
+	assert((L == 2 && M == 1) || (L == 1 && M == 2));
+	assert(N & 1);
+	assert(src->past >= (N + L - 1) / L - 1);
+
+	X(stage) *hbs = FSRC_HEAP_NEW(heap, X(stage));
+	if(!hbs)
+		return FSRC_E_NOMEM;
+
+	hbs->vt = &vt;
+	hbs->up = L;
+	hbs->dn = M;
+	hbs->n = N;
+	hbs->l = 0;
+
+	/* 
+		the symmetric taps are the ones an odd distance from the center. 
+		interpolating, they make up the other phase, and the center tap is 
+		how far back it is in its own
+	*/
+	const double *h = ms->h;
+	size_t c = (N - 1) / 2;
+	size_t t0 = (c + 1) & 1;
+
+	hbs->na = (N - t0 + 1) / 2;
+	hbs->t0 = t0;
+	hbs->pc = (unsigned)(c & 1);
+	hbs->dc = L == 2 ? c / 2 : c;
+	hbs->g = (REAL)(h[c] * L);
+
+	size_t m = X(ntaps)(N);
+	hbs->a = FSRC_HEAP_ARRAY(heap, REAL, m);
+	if(!hbs->a) {
+		fsrc_heap_free(heap, hbs);
+		return FSRC_E_NOMEM;
+	}
+
+	for(size_t i = 0; i < m; ++i)
+		hbs->a[i] = (REAL)(h[t0 + 2 * i] * L);
+
+	hbs->src = src;
+	hbs->dst = dst;
+	hbs->chans = chans;
+	hbs->heap = heap;
+
+	*s = (fsrc_stage*)hbs;
+
+	return FSRC_S_OK;
+}
+
+#undef REAL 
+#undef ACC
+#undef X__
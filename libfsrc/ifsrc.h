@@ -54,7 +54,7 @@
 #define LIBFSRC_64
 #endif
 
-#define FSRC_MAX_STAGES 3
+#define FSRC_MAX_STAGES 5
 
 #undef MIN
 #undef MAX
@@ -66,6 +66,41 @@
 #define FSRC_ARRAY(type, n) (type*)malloc((n) * sizeof(type))
 #define FSRC_MM_ARRAY(type, n) (type*)fsrc_alloc((n) * sizeof(type))
 
+/* 
+	for fsrc_prepare, in alloc.c. touching faults the pages in, writable 
+	memory is written back to itself, a read may only map a zero page. 
+	lock returns nonzero on failure. the pages are counted, so one stays 
+	locked until every region on it is unlocked
+*/
+void fsrc_mem_touch(const void *p, size_t size, int write);
+int fsrc_mem_lock(const void *p, size_t size);
+void fsrc_mem_unlock(const void *p, size_t size);
+
+/* 
+	where a converter's memory comes from, see fsrc_create_ex. with an 
+	arena, allocations are carved from it front to back, cache line 
+	aligned, and freed with it. without one, they're counted in used, 
+	which is what an arena takes
+*/
+typedef struct fsrc_heap {
+	fsrc_allocator a;
+	void *block;	/* what a.alloc returned, the arena is in it */
+	char *arena;
+	size_t size;
+	size_t used;
+} fsrc_heap;
+
+/* a is optional. returns 0 if out of memory */
+fsrc_heap *fsrc_heap_create(const fsrc_allocator *a, size_t arena);
+void fsrc_heap_destroy(fsrc_heap *h);
+void *fsrc_heap_alloc(fsrc_heap *h, size_t size);
+void fsrc_heap_free(fsrc_heap *h, void *p);
+/* what an allocation of size takes from an arena */
+size_t fsrc_heap_need(size_t size);
+
+#define FSRC_HEAP_NEW(h, type) (type*)fsrc_heap_alloc(h, sizeof(type))
+#define FSRC_HEAP_ARRAY(h, type, n) (type*)fsrc_heap_alloc(h, (n) * sizeof(type))
+
 #define FSRC_DOWNCAST(addr, type, member) ((type*)((char*)addr - offsetof(type, member)))
 
 #endif
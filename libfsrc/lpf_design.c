@@ -23,10 +23,11 @@
 #include "fft.h"
 #include "xblas.h"
 #include <math.h>
+#include <float.h>
 #include <string.h>
 #include <assert.h>
 
-size_t lpf_len(double df, double d1, double d2)
+double fsrc_lpf_len(double df, double d1, double d2)
 {
 	double logd1 = log10(d1);
 	double logd2 = log10(d2);
@@ -36,15 +37,67 @@ size_t lpf_len(double df, double d1, double d2)
 		(5.309e-3 * logd12 + 7.114e-2 * logd1 - 4.761e-1) * logd2
 		- 2.66e-3 * logd12 - 5.941e-1 * logd1 - 4.278e-1;
 
-	return (size_t)ceil(2 * D / df + 1);
+	return 2 * D / df + 1;
 }
 
+/* 
+	the length search stops once the shortest passing length is bracketed,
+	or after this many solves if a passing one is known.
+*/
+#define LPF_MAX_SOLVES 8
+
+/* the fraction of the target error to aim for when the passing length is not known yet */
+#define LPF_AIM 0.9
+
+/* a shorter length is only tried if it's expected to save at least 1/LPF_MIN_GAIN of the taps */
+#define LPF_MIN_GAIN 100
+
+/* how much longer than the length estimate fsrc_lpf_window's stand-ins are at least */
+#define LPF_STANDIN_SLACK 1.25
+
 fsrc_err fsrc_fir_minphase_dht(size_t n, const double *h, double *g, double dp, double ds);
-fsrc_err fsrc_fir_minphase(size_t N, const double *h, double *g);
+fsrc_err fsrc_fir_minphase(size_t N, const double *h, double *g, const fsrc_lps *lps, double tol);
 
 #define FSRC_MINPHASE_OPT 0
 
-fsrc_err fsrc_lpf_design(fsrc_lpc *lpf, const fsrc_lps *spec)
+/* the share of the ripple left to the minimum phase conversion */
+#define MINPHASE_TOL 0.25
+
+/* 
+	the length the search starts from. it only tries lengths of the same 
+	parity, so the result has the parity of this too, halfbands aside
+*/
+static size_t lpf_start_len(const fsrc_lps *spec, const fsrc_lpf_hint *hint, double rp, double rs)
+{
+	double kn = (hint && hint->kn > 0) ? hint->kn : 1;
+	size_t n = (size_t)ceil(kn * fsrc_lpf_len(spec->fs - spec->fp, rp, rs));
+
+	/* a hint is started from, so its parity is kept */
+	if(hint && hint->lpc.h && !(spec->flags & FSRC_LPF_HALFBAND) && ((n ^ hint->lpc.n) & 1))
+		++n;
+
+	return n;
+}
+
+/* the length the search starts from, in G's lengths for a halfband, see below */
+static size_t lpf_search_len(const fsrc_lps *spec, const fsrc_lpf_hint *hint, double rp, double rs)
+{
+	size_t n = lpf_start_len(spec, hint, rp, rs);
+
+	if(spec->flags & FSRC_LPF_HALFBAND) {
+		n = (n + 1) / 2;
+		n += n & 1;
+	}
+
+#if FSRC_MINPHASE_OPT
+	if(spec->flags & FSRC_LPF_MINPHASE)
+		n |= 1;
+#endif
+
+	return n;
+}
+
+fsrc_err fsrc_lpf_design(fsrc_lpc *lpf, const fsrc_lps *spec, const fsrc_lpf_hint *hint)
 {
 	fsrc_err err = FSRC_S_OK;
 
@@ -58,6 +111,11 @@ fsrc_err fsrc_lpf_design(fsrc_lpc *lpf, const fsrc_lps *spec)
 		rp = 4 * rp / rden;
 		rs = rs * rs / rden;
 	}
+#else
+	if(flags & FSRC_LPF_MINPHASE) {
+		rp *= 1 - MINPHASE_TOL;
+		rs *= 1 - MINPHASE_TOL;
+	}
 #endif
 
 	double f[] = { spec->fp, spec->fs };
@@ -65,15 +123,29 @@ fsrc_err fsrc_lpf_design(fsrc_lpc *lpf, const fsrc_lps *spec)
 	double delm = MIN(rp, rs);
 	double w[] = { delm / rp, delm / rs };
 
-	double del = delm;
+	/* 
+		a halfband is (z^-(n-1) + G(z^2)) / 2, G being an even length design 
+		that only has a passband, out to twice the halfband's. the error of 
+		G is halved in both bands. n is G's length until the very end
+	*/
+	int half = flags & FSRC_LPF_HALFBAND;
+	assert(!half || !(flags & FSRC_LPF_MINPHASE));
+	if(half) {
+		f[0] = 2 * spec->fp;
+		f[1] = 1;
+		w[0] = w[1] = 1;
+		delm = 2 * MIN(rp, rs);
+	}
 
 	fir_irls_spec irls = {
 		0, 0,
 		2, f, a, w,
-		1e-5, 1e-13
+		1e-5, 1e-13,
+		0, 0, 0, 0,
+		FIR_IRLS_KEEP_WEIGHTS
 	};
 #if 0
-	if(del < 1e-8) {
+	if(delm < 1e-8) {
 		/* this is hackish. fix later. */
 		irls.irls_tol = 5e-6;
 		irls.pcg_tol = 1e-12;
@@ -82,36 +154,151 @@ fsrc_err fsrc_lpf_design(fsrc_lpc *lpf, const fsrc_lps *spec)
 
 	double df = spec->fs - spec->fp;
 
-	size_t n = lpf_len(df, rp, rs);
+	size_t n = lpf_search_len(spec, hint, rp, rs);
 
-	for(;;) {
-#if FSRC_MINPHASE_OPT
-		if(flags & FSRC_LPF_MINPHASE)
-			n |= 1;
-#endif
+	/* G's lengths go half as far */
+	double ks = half ? 0.5 : 1;
+
+	/* a halfband hint would have to be taken apart first */
+	if(hint && hint->lpc.h && !half) {
+		/* start from the unique half of the hint, n has its parity */
+		size_t l = (hint->lpc.n + 1) / 2;
+		irls.n0 = hint->lpc.n;
+		irls.h0 = hint->lpc.h + hint->lpc.n - l;
+	}
 
+	/* 
+		where to start over from if the first attempts fail. without the 
+		hint, or the length estimate's calibration, but with the same parity
+	*/
+	size_t n0 = lpf_search_len(spec, 0, rp, rs);
+	n0 += (n0 ^ n) & 1;
+	int retried = 0;
+
+	/* 
+		the parity is fixed from here on. lo is the longest failing length, 
+		hi the shortest passing one, and dlo, dhi their weighted errors.
+	*/
+	size_t lo = 0, hi = 0;
+	double dlo = 0, dhi = 0;
+
+	/* the shortest passing design */
+	double *hb = 0;
+
+	/* the previous attempt. hp may be hb */
+	double *hp = 0;
+	double *wp = 0;
+
+	for(int k = 1; ; ++k) {
 		irls.h = (double*)fsrc_alloc(n * sizeof(double));
 		irls.n = n;
 
 		fir_irls_info inf;
-		int ret = fir_irls(&irls, &inf);
+		int ret = irls.h ? fir_irls(&irls, &inf) : 0;
+
+		if(hp != hb)
+			fsrc_free(hp);
+		fsrc_free(wp);
+		hp = wp = 0;
+
 		if(ret <= 0) {
 			fsrc_free(irls.h);
+			/* a shorter attempt may fail to converge. that's fine if something already passed */
+			if(ret < 0 && hb)
+				break;
+			/* 
+				otherwise it may be down to where it was started from, the 
+				hint or the previous attempt, or to a length estimate skewed 
+				by what's cached. start over without any of them, once
+			*/
+			if(ret < 0 && (irls.h0 || n != n0) && !retried) {
+				retried = 1;
+				n = n0;
+				lo = 0;
+				dlo = 0;
+				irls.n0 = 0;
+				irls.h0 = 0;
+				irls.nw0 = 0;
+				irls.w0 = 0;
+				k = 0;
+				continue;
+			}
+			fsrc_free(hb);
 			return ret < 0 ? FSRC_E_INTERNAL : FSRC_E_NOMEM;
 		}
 
-		if(inf.del <= delm)
+		if(inf.del <= delm) {
+			fsrc_free(hb);
+			hb = irls.h;
+			hi = n;
+			dhi = inf.del;
+		} else {
+			lo = n;
+			dlo = inf.del;
+		}
+
+		/* the next attempt starts where this one finished */
+		hp = irls.h;
+		wp = inf.w;
+		irls.n0 = n;
+		irls.h0 = hp;
+		irls.nw0 = inf.nw;
+		irls.w0 = wp;
+
+		/* 
+			near the optimum, the achieved error is not quite monotonic in the
+			length. so once something passed, stop at the first failure
+		*/
+		if(hi && (hi <= lo + 2 || hi != n || k >= LPF_MAX_SOLVES))
 			break;
 
-		del *= pow(delm / inf.del, 2);
-		size_t m = lpf_len(df, del / w[0], del / w[1]);
-		assert(m >= n);
-		if(m == n) {
-			n += 2;
+		/* 
+			the error falls off roughly exponentially with the length, so
+			interpolate in log(del) between the bracketing lengths. otherwise,
+			step by what the length estimate says the remaining error is worth.
+			when searching upwards, aim a little low, so the next one passes.
+		*/
+		double dt = hi ? delm : LPF_AIM * delm;
+		double x;
+		if(lo && hi) {
+			x = lo + (hi - lo) * log(dlo / dt) / log(dlo / dhi);
+		} else {
+			x = n + ks * (fsrc_lpf_len(df, dt / w[0], dt / w[1]) 
+				- fsrc_lpf_len(df, inf.del / w[0], inf.del / w[1]));
+		}
+
+		size_t m = x > 0 ? (size_t)ceil(x) : 0;
+		m += (m ^ n) & 1;
+
+		if(!hi) {
+			if(m <= lo)
+				m = lo + 2;
 		} else {
-			n = m;
-		}				
-	}	
+			/* only try shorter if it's likely to be worth a solve */
+			if(m + 2 >= hi || (hi - m) * LPF_MIN_GAIN < hi)
+				break;
+			if(m <= lo)
+				m = lo + 2;
+		}
+
+		if(m < n) {
+			/* 
+				the weights of a longer design are close to a fixed point of 
+				the iteration, which then stops too early. only keep h
+			*/
+			irls.nw0 = 0;
+			irls.w0 = 0;
+		}
+
+		n = m;
+	}
+
+	if(hp != hb)
+		fsrc_free(hp);
+	fsrc_free(wp);
+
+	n = hi;
+	irls.h = hb;
 
 	size_t l = (n + 1) / 2;
 	double *h = irls.h;
@@ -119,6 +306,24 @@ fsrc_err fsrc_lpf_design(fsrc_lpc *lpf, const fsrc_lps *spec)
 	memmove(h + n - l, h, l * sizeof(double));
 	fsrc_dcopy(n - l, h + l, 1, h, -1);
 
+	if(half) {
+		double *g = h;
+		size_t m = 2 * n - 1;
+		h = (double*)fsrc_alloc(m * sizeof(double));
+		if(!h) {
+			fsrc_free(g);
+			return FSRC_E_NOMEM;
+		}
+
+		memset(h, 0, m * sizeof(double));
+		for(size_t i = 0; i < n; ++i)
+			h[2 * i] = g[i] / 2;
+		h[n - 1] = 0.5;
+
+		fsrc_free(g);
+		n = m;
+	}
+
 	if(flags & FSRC_LPF_MINPHASE) {
 #if FSRC_MINPHASE_OPT
 		err = fsrc_fir_minphase_dht(n, h, h, rp, rs);
@@ -127,14 +332,82 @@ fsrc_err fsrc_lpf_design(fsrc_lpc *lpf, const fsrc_lps *spec)
 		else
 			fsrc_free(h);
 #else
-		err = fsrc_fir_minphase(n, h, h);
+		err = fsrc_fir_minphase(n, h, h, spec, MINPHASE_TOL);
 		if(err != FSRC_S_OK)
 			fsrc_free(h);
 #endif
 	}
 
+	if(err != FSRC_S_OK)
+		return err;
+
 	lpf->h = h;
 	lpf->n = n;
 
 	return err;
 }
+
+/* msvc doesn't define M_PI */
+#define FSRC_PI 3.14159265358979323846
+
+/* modified bessel function of the first kind, order 0 */
+static double fsrc_bessel_i0(double x)
+{
+	double s = 1, t = 1;
+	for(int k = 1; t > s * DBL_EPSILON; ++k) {
+		t *= (x / (2 * k)) * (x / (2 * k));
+		s += t;
+	}
+	return s;
+}
+
+fsrc_err fsrc_lpf_window(fsrc_lpc *lpf, const fsrc_lps *spec, const fsrc_lpf_hint *hint)
+{
+	double del = MIN(spec->dp, spec->ds);
+	double A = -20 * log10(del);
+	double beta = 0;
+	if(A > 50)
+		beta = 0.1102 * (A - 8.7);
+	else if(A > 21)
+		beta = 0.5842 * pow(A - 21, 0.4) + 0.07886 * (A - 21);
+
+	/* the frequencies are relative to Nyquist, kaiser's formula wants cycles per sample */
+	double df = spec->fs - spec->fp;
+	size_t n = (size_t)ceil((A - 7.95) / (14.36 * df / 2)) + 1;
+	n = MAX(n, 3);
+
+	/* 
+		a stand-in for the final design, which gets padded to its length. 
+		so it shouldn't be shorter than the length search is likely to end at
+	*/
+	size_t m = (size_t)ceil(LPF_STANDIN_SLACK * lpf_start_len(spec, hint, spec->dp, spec->ds));
+	n = MAX(n, m);
+
+	/* a halfband's edges are symmetric about 1/2, so every other tap is zero. odd n keeps the center on one */
+	int half = spec->flags & FSRC_LPF_HALFBAND;
+	if(half)
+		n |= 1;
+	else
+		n += (n ^ lpf_start_len(spec, hint, spec->dp, spec->ds)) & 1;
+
+	double *h = (double*)fsrc_alloc(n * sizeof(double));
+	if(!h)
+		return FSRC_E_NOMEM;
+
+	double fc = (spec->fp + spec->fs) / 2;
+	double c = (n - 1) / 2.0;
+	double ib = fsrc_bessel_i0(beta);
+	for(size_t k = 0; k < n; ++k) {
+		double t = k - c;
+		double r = t / c;
+		double w = fsrc_bessel_i0(beta * sqrt(MAX(0, 1 - r * r))) / ib;
+		h[k] = w * (t == 0 ? fc : sin(FSRC_PI * fc * t) / (FSRC_PI * t));
+		if(half && t != 0 && fmod(t, 2) == 0)
+			h[k] = 0;
+	}
+
+	lpf->h = h;
+	lpf->n = n;
+
+	return FSRC_S_OK;
+}
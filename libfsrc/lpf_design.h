@@ -26,6 +26,12 @@ typedef struct fsrc_lpc {
 	double *h;
 } fsrc_lpc;
 
+/* 
+	besides the public FSRC_LPF_ ones. fp + fs = 1 and dp = ds. the result 
+	has odd length, and every other tap but the center one is zero
+*/
+#define FSRC_LPF_HALFBAND	0x100
+
 /* low-pass spec */
 typedef struct fsrc_lps { 
 	double fs;
@@ -36,7 +42,28 @@ typedef struct fsrc_lps {
 	uint32_t pad;
 } fsrc_lps;
 
-fsrc_err fsrc_lpf_design(fsrc_lpc *lpf, const fsrc_lps *lps);
+/* what's known about a spec before designing it */
+typedef struct fsrc_lpf_hint {
+	/* a linear phase design for a similar spec. the optimization is started from it */
+	fsrc_lpc lpc;
+	/* how far off the length estimate was for similar specs (actual / estimated), 0 if unknown */
+	double kn;
+} fsrc_lpf_hint;
+
+/* estimated length of a low-pass with transition width df, not rounded */
+double fsrc_lpf_len(double df, double dp, double ds);
+
+/* hint is optional */
+fsrc_err fsrc_lpf_design(fsrc_lpc *lpf, const fsrc_lps *lps, const fsrc_lpf_hint *hint);
+
+/* 
+	a kaiser window design. takes no time, but it's longer than an optimized 
+	one, only roughly to spec and always linear phase. its length has the 
+	parity fsrc_lpf_design's would have, given the same hint, and it's 
+	comfortably longer than the length estimate, so the final design can 
+	be padded to it when it stands in for one
+*/
+fsrc_err fsrc_lpf_window(fsrc_lpc *lpf, const fsrc_lps *lps, const fsrc_lpf_hint *hint);
 
 #endif
 
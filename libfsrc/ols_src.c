@@ -22,6 +22,7 @@
 #include "design.h"
 #include "fft.h"
 #include "xblas.h"
+#include "tables.h"
 #include <stdlib.h>
 #include <assert.h>
 #include <string.h>
@@ -49,13 +49,14 @@ typedef struct X(stage) {
 	size_t Ns;
 	size_t Ms;
 
-	F(complex) *H;
+	const F(complex) *H; /* shared with I, see tables.h */
+	fsrc_table *tab;
 
 	REAL *x;
 	F(complex) *X;
 	F(complex) *Y;
 
-	size_t *I;
+	const size_t *I;
 	
 	F(fft) dft;
 	F(fft) idft;
@@ -63,22 +64,23 @@ typedef struct X(stage) {
 	fsrc_iobuf *src;
 	fsrc_iobuf *dst;
 	size_t chans;
+
+	fsrc_heap *heap;
 } X(stage);
 
 static void X(destroy)(fsrc_stage *s)
 {
 	X(stage) *ols = (X(stage)*)s;
 
-	fsrc_free(ols->x);
-	fsrc_free(ols->X);
-	fsrc_free(ols->Y);
-	fsrc_free(ols->H);
-	free(ols->I);
+	fsrc_heap_free(ols->heap, ols->x);
+	fsrc_heap_free(ols->heap, ols->X);
+	fsrc_heap_free(ols->heap, ols->Y);
+	fsrc_table_release(ols->tab);
 
 	F(fft_destroy)(ols->dft);
 	F(fft_destroy)(ols->idft);
 
-	free(ols);
+	fsrc_heap_free(ols->heap, ols);
 }
 
 static fsrc_err X(process)(fsrc_stage *s)
@@ -107,8 +109,7 @@ static fsrc_err X(process)(fsrc_stage *s)
 	REAL *dd = (REAL*)ols->dst->data;
 	size_t ds = ols->dst->size;
 	size_t dp = ols->dst->pos;
-	size_t dh = ols->dst->past;
-	if(ds - dh < dn)
+	if(ds - dp < dn)
 		return FSRC_S_BUFFER_FULL;
 
 	/*assert((ss - sh) / D == (ds - dh) / U);*/
@@ -120,9 +121,9 @@ static fsrc_err X(process)(fsrc_stage *s)
 
 	F(complex) *RESTRICT X = ols->X;
 	F(complex) *RESTRICT Y = ols->Y;
-	F(complex) *RESTRICT H = ols->H;
+	const F(complex) *RESTRICT H = ols->H;
 
-	size_t *I = ols->I;
+	const size_t *I = ols->I;
 
 	size_t MB = M / 2 + 1; /* number of non-redundant bins */
 
@@ -179,57 +180,79 @@ static void X(reset)(fsrc_stage *s)
 
 }
 
-fsrc_err X(create)(const fsrc_stage_model *ms, fsrc_stage **s, fsrc_iobuf *src, fsrc_iobuf *dst, size_t chans)
+/* blocks always start on a whole number of periods, so there's no phase to carry over */
+static void X(resume)(fsrc_stage *s, const fsrc_stage *from)
 {
-	static const fsrc_stage_vt ols_vt = {
-		X(destroy),
-		X(process),
-		X(reset)
-	};
-
-	assert(src->past >= (ms->n + ms->ratio.up - 1) / ms->ratio.up - 1);
+	(void)s;
+	(void)from;
+}
 
-	X(stage) *ols = FSRC_NEW(X(stage));
+/* whole blocks, Ns less the history each */
+static size_t X(need)(const fsrc_stage *s, size_t n)
+{
+	const X(stage) *ols = (const X(stage)*)s;
+	size_t nb = (n + ols->Ms - 1) / ols->Ms;
 
-	memset(ols, 0, sizeof(X(stage)));
+	return nb * (ols->Ns - ols->src->past);
+}
 
-	ols->vt = &ols_vt;
+/* the fft plans' own memory is fftw's business */
+static size_t X(regions)(const fsrc_stage *s, fsrc_region *r)
+{
+	const X(stage) *ols = (const X(stage)*)s;
+	size_t N = ols->K * ols->dn;
+	size_t M = ols->K * ols->up;
+
+	r[0].p = ols;
+	r[0].size = sizeof(X(stage));
+	r[1].p = ols->x;
+	r[1].size = MAX(N, M) * sizeof(REAL);
+	r[2].p = ols->X;
+	r[2].size = N * sizeof(F(complex));
+	r[3].p = ols->Y;
+	r[3].size = M * sizeof(F(complex));
+	r[4].p = 0;
+	r[4].size = 0;
+	for(size_t i = 0; i < 4; ++i)
+		r[i].tab = 0;
+	r[4].tab = ols->tab;
+
+	return 5;
+}
 
-	unsigned U = ms->ratio.up;
-	unsigned D = ms->ratio.dn;
+typedef struct X(spectrum_arg) {
+	const fsrc_stage_model *ms;
+	size_t K;
+} X(spectrum_arg);
 
-	ols->up = U;
-	ols->dn = D;
+/* the filter spectrum H, followed by the input bin indices I */
+static fsrc_err X(init_spectrum)(void *data, const void *arg)
+{
+	const X(spectrum_arg) *sa = (const X(spectrum_arg)*)arg;
+	const fsrc_stage_model *ms = sa->ms;
 
-	ols->n = ms->n;
+	size_t U = ms->ratio.up;
+	size_t D = ms->ratio.dn;
+	size_t K = sa->K;
 
-	assert((src->size - src->past) % D == 0);
-	assert((dst->size - dst->past) % U == 0);
-
-	size_t UD = (size_t)U * D;
+	size_t N = K * D;
+	size_t L = K * U * D;
 
 	size_t Nh = (ms->n + U - 1) / U - 1;
 
-	assert(Nh == src->past);
-
-	size_t Ns = src->size - src->past;
-
-	size_t K = ((Ns + Nh) * U + UD - 1) / UD;
-	K = fsrc_fft_opt_size_high(K, FSRC_FFT_SIZE_ANY);
-
-	size_t N = K * D;
-	size_t M = K * U;
-	size_t L = K * UD;
-
-	// set input buffer size to N
-	// set output buffer size to M
-	// set fft size to N and M
+	F(complex) *H = (F(complex)*)data;
+	size_t *I = (size_t*)(H + L);
 
 	REAL *h = FSRC_MM_ARRAY(REAL, L);
-	F(complex) *H = FSRC_MM_ARRAY(F(complex), L);
+	if(!h)
+		return FSRC_E_NOMEM;
 
 	F(fft) dft;
 	fsrc_err err = F(rcdft_init)(&dft, L, h, H, 0);
+	if(err != FSRC_S_OK) {
+		fsrc_free(h);
+		return err;
+	}
 
 	assert(Nh * U < ms->n);
 
@@ -261,20 +284,120 @@ fsrc_err X(create)(const fsrc_stage_model *ms, fsrc_stage **s, fsrc_iobuf *src,
 		H[l][1] = -H[L - l][1];
 	}
 
-	size_t *I = FSRC_ARRAY(size_t, L);
 	for(size_t l = 0; l < L; ++l)
 		I[l] = l % N;
 
+	return FSRC_S_OK;
+}
+
+/* the transform size, in periods of the ratio, for blocks of src's size */
+static size_t X(periods)(const fsrc_stage_model *ms, const fsrc_iobuf *src)
+{
+	size_t U = ms->ratio.up;
+	size_t UD = U * ms->ratio.dn;
+	/* the new samples and the history before them */
+	size_t K = (src->size * U + UD - 1) / UD;
+	return fsrc_fft_opt_size_high(K, FSRC_FFT_SIZE_ANY);
+}
+
+/* what X(create) takes from the heap, the spectrum is a shared table */
+size_t X(heap)(const fsrc_stage_model *ms, const fsrc_iobuf *src, const fsrc_iobuf *dst)
+{
+	(void)dst;
+	size_t K = X(periods)(ms, src);
+	size_t N = K * ms->ratio.dn;
+	size_t M = K * ms->ratio.up;
+	return fsrc_heap_need(sizeof(X(stage))) + fsrc_heap_need(MAX(N, M) * sizeof(REAL)) 
+		+ fsrc_heap_need(N * sizeof(F(complex))) + fsrc_heap_need(M * sizeof(F(complex)));
+}
+
+fsrc_err X(create)(const fsrc_stage_model *ms, fsrc_stage **s, fsrc_iobuf *src, fsrc_iobuf *dst, size_t chans, fsrc_heap *heap)
+{
+	static const fsrc_stage_vt ols_vt = {
+		X(destroy),
+		X(process),
+		X(reset),
+		X(resume),
+		X(need),
+		X(regions)
+	};
+
+	assert(src->past >= (ms->n + ms->ratio.up - 1) / ms->ratio.up - 1);
+
+	X(stage) *ols = FSRC_HEAP_NEW(heap, X(stage));
+	if(!ols)
+		return FSRC_E_NOMEM;
+
+	memset(ols, 0, sizeof(X(stage)));
+
+	ols->vt = &ols_vt;
+
+	unsigned U = ms->ratio.up;
+	unsigned D = ms->ratio.dn;
+
+	ols->up = U;
+	ols->dn = D;
+
+	ols->n = ms->n;
+
+	assert((src->size - src->past) % D == 0);
+	assert((dst->size - dst->past) % U == 0);
+
+	size_t UD = (size_t)U * D;
+
+	/* the history is the filter's span */
+	assert((ms->n + U - 1) / U - 1 == src->past);
+
+	size_t K = X(periods)(ms, src);
+
+	size_t N = K * D;
+	size_t M = K * U;
+	size_t L = K * UD;
+
+	// set input buffer size to N
+	// set output buffer size to M
+	// set fft size to N and M
+
+	/* converters with the same stage share the spectrum */
+	fsrc_table_key key;
+	memset(&key, 0, sizeof(key));
+	key.kind = FSRC_TABLE_OLS;
+	key.p[0] = U;
+	key.p[1] = D;
+	key.p[2] = K;
+	key.p[3] = sizeof(REAL);
+	key.n = ms->n;
+	key.hash = fsrc_table_hash(ms->h, ms->n);
+	key.h = ms->h;
+
+	X(spectrum_arg) sa = { ms, K };
+
+	const void *H;
+	size_t size = L * (sizeof(F(complex)) + sizeof(size_t));
+	fsrc_err err = fsrc_table_get(&ols->tab, &H, &key, size, X(init_spectrum), &sa, ms->cache);
+	if(err != FSRC_S_OK) {
+		fsrc_heap_free(heap, ols);
+		return err;
+	}
+
 	ols->K = K;
 	ols->Ns = src->size;
 	ols->Ms = dst->size - dst->past;
 
-	ols->H = H;
-
-	ols->x = FSRC_MM_ARRAY(REAL, MAX(N, M));
-	ols->X = FSRC_MM_ARRAY(F(complex), N);
-	ols->Y = FSRC_MM_ARRAY(F(complex), M);
-	ols->I = I;
+	ols->H = (const F(complex)*)H;
+	ols->I = (const size_t*)(ols->H + L);
+
+	ols->x = FSRC_HEAP_ARRAY(heap, REAL, MAX(N, M));
+	ols->X = FSRC_HEAP_ARRAY(heap, F(complex), N);
+	ols->Y = FSRC_HEAP_ARRAY(heap, F(complex), M);
+	if(!ols->x || !ols->X || !ols->Y) {
+		fsrc_heap_free(heap, ols->x);
+		fsrc_heap_free(heap, ols->X);
+		fsrc_heap_free(heap, ols->Y);
+		fsrc_table_release(ols->tab);
+		fsrc_heap_free(heap, ols);
+		return FSRC_E_NOMEM;
+	}
 
 	err = F(rcdft_init)(&ols->dft, N, ols->x, ols->X, 0);
 	err = F(crdft_init)(&ols->idft, M, ols->X, ols->x, 0);
@@ -282,6 +405,7 @@ fsrc_err X(create)(const fsrc_stage_model *ms, fsrc_stage **s, fsrc_iobuf *src,
 	ols->src = src;
 	ols->dst = dst;
 	ols->chans = chans;
+	ols->heap = heap;
 
 	*s = (fsrc_stage*)ols;
 
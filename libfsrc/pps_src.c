@@ -20,25 +20,115 @@
 #include "ifsrc.h"
 #include "design.h"
 #include "stage.h"
+#include "tables.h"
 #include "bits.h"
 #include <string.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <math.h>
+
+/* the phase bank's layout, it's part of the table key */
+#define FSRC_PPS_LAYOUT 1
+#define FSRC_PPS_ALIGN 64
+
+/* the block kernel is used when every phase has this many outputs */
+#define FSRC_PPS_BLOCK 4
+
+/* how a phase's coefs are stored, see init_phases */
+enum {
+	FSRC_PHASE_PLAIN,
+	FSRC_PHASE_MIRROR,	/* another phase's, backwards */
+	FSRC_PHASE_FOLDED	/* symmetric, the first half */
+};
 
 #define X_(name) X__(name)
 #define X(name) X_(name)
 
 #define X__(name) dpps_ ## name 
 #define REAL double
+#define COEF double
+#define ACC double
+#define QUANT(c) (c)
+#define STORE(y) (y)
+#define TABLE FSRC_TABLE_PPS
 #define POLYPHASE dpolyphase
 
 #include "pps_src_impl.h"
 
 #define X__(name) spps_ ## name 
 #define REAL float
+#define COEF float
+#define ACC float
+#define QUANT(c) (float)(c)
+#define STORE(y) (y)
+#define TABLE FSRC_TABLE_PPS
 #define POLYPHASE spolyphase
 
 #include "pps_src_impl.h"
 
+/* float samples and coefs, double sums, see FSRC_MIXED. the tables are the float ones */
+#define X__(name) mpps_ ## name 
+#define REAL float
+#define COEF float
+#define ACC double
+#define QUANT(c) (float)(c)
+#define STORE(y) (float)(y)
+#define TABLE FSRC_TABLE_PPS
+#define POLYPHASE mpolyphase
+
+#include "pps_src_impl.h"
+
+/*
+	the fixed point ones, see FSRC_FIXED. the samples are full scale 16 or 
+	32 bit integers, the coefs have two integer bits, since a phase's taps 
+	can go a bit over 1. the sums are twice as wide as the samples, so they 
+	don't overflow unless a phase's taps add up to 4 in absolute value
+*/
+static int16_t fsrc_quant_q14(double c)
+{
+	double q = floor(c * (1 << 14) + 0.5);
+	return (int16_t)(q > INT16_MAX ? INT16_MAX : (q < INT16_MIN ? INT16_MIN : q));
+}
+
+static int32_t fsrc_quant_q30(double c)
+{
+	double q = floor(c * (1 << 30) + 0.5);
+	return (int32_t)(q > INT32_MAX ? INT32_MAX : (q < INT32_MIN ? INT32_MIN : q));
+}
+
+static int16_t fsrc_store_q14(int32_t y)
+{
+	y = (int32_t)(((int64_t)y + (1 << 13)) >> 14);
+	return (int16_t)(y > INT16_MAX ? INT16_MAX : (y < INT16_MIN ? INT16_MIN : y));
+}
+
+static int32_t fsrc_store_q30(int64_t y)
+{
+	y = (y + (1 << 29)) >> 30;
+	return (int32_t)(y > INT32_MAX ? INT32_MAX : (y < INT32_MIN ? INT32_MIN : y));
+}
+
+#define X__(name) wpps_ ## name 
+#define REAL int16_t
+#define COEF int16_t
+#define ACC int32_t
+#define QUANT(c) fsrc_quant_q14(c)
+#define STORE(y) fsrc_store_q14(y)
+#define TABLE FSRC_TABLE_IPS
+#define POLYPHASE wpolyphase
+
+#include "pps_src_impl.h"
+
+#define X__(name) lpps_ ## name 
+#define REAL int32_t
+#define COEF int32_t
+#define ACC int64_t
+#define QUANT(c) fsrc_quant_q30(c)
+#define STORE(y) fsrc_store_q30(y)
+#define TABLE FSRC_TABLE_IPS
+#define POLYPHASE lpolyphase
+
+#include "pps_src_impl.h"
+
 
 
@@ -19,18 +19,27 @@
 */
 
 /*
-	this is an implementation of the usual POLYPHASE sample rate conversion
+	this is an implementation of the usual POLYPHASE sample rate conversion. 
+	REAL is the sample type, COEF the coefficient type, the products are 
+	summed in ACC, and STORE turns the sums back into samples. QUANT makes a 
+	coef out of a double. for the floating point stages they're all the same, 
+	but for the mixed ones' sums
 
 	the way various indices are computed might be interesing
 */
 
-/* the awesome POLYPHASE structure */
+/* 
+	the awesome POLYPHASE structure. the phases are stored in the order 
+	they're used in, phase l is followed by phase (l + M) mod L, so the bank 
+	is streamed through front to back. the descriptors are separate arrays, 
+	indexed by the position in that order, and the coefs follow them
+*/
 typedef struct POLYPHASE {	
-	REAL *p;	/* POLYPHASE coefs */
-	size_t n;	/* number of coefs */
-
-	unsigned q;	/* source index increment */
-	unsigned r;	/* next phase */
+	const unsigned *o;		/* offsets of the coefs, so the bank can be mapped anywhere */
+	const unsigned *n;		/* number of coefs */
+	const unsigned *q;		/* source index increment */
+	const unsigned *sym;	/* how the coefs are stored, see init_phases */
+	const unsigned *slot;	/* the position of phase l */
 } POLYPHASE;
 
 typedef struct X(stage) {
@@ -43,20 +52,117 @@ typedef struct X(stage) {
 
 	unsigned l;	/* start phase */
 
-	POLYPHASE *pphs;
+	POLYPHASE pphs; /* points into a shared table, see tables.h */
+	const COEF *coefs;
+	fsrc_table *tab;
 
 	fsrc_iobuf *src;
 	fsrc_iobuf *dst;
 	size_t chans;
+
+	fsrc_heap *heap;
 } X(stage);
 
 static void X(destroy)(fsrc_stage *s)
 {
 	X(stage) *pps = (X(stage)*)s;
 
-	free(pps->pphs[0].p);
-	free(pps->pphs);
-	free(pps);
+	fsrc_table_release(pps->tab);
+	fsrc_heap_free(pps->heap, pps);
+}
+
+/* one output of a phase, x points at the newest input sample */
+static ACC X(dot)(const COEF *RESTRICT p, ptrdiff_t nl, unsigned sym, const REAL *RESTRICT x)
+{
+	/* the subfilter coefs are reversed */
+	const REAL *RESTRICT xk = x - nl + 1;
+
+	ACC y = 0;
+	switch(sym) {
+	case FSRC_PHASE_PLAIN:
+		for(ptrdiff_t i = 0; i < nl; ++i)
+			y += (ACC)p[i] * xk[i];
+		break;
+	case FSRC_PHASE_MIRROR:
+		for(ptrdiff_t i = 0; i < nl; ++i)
+			y += (ACC)p[i] * x[-i];
+		break;
+	default:
+		for(ptrdiff_t i = 0; i < nl / 2; ++i)
+			y += (ACC)p[i] * ((ACC)xk[i] + x[-i]);
+		if(nl & 1)
+			y += (ACC)p[nl / 2] * xk[nl / 2];
+	}
+
+	return y;
+}
+
+/* 
+	n outputs of one phase, ys apart, each xs inputs further on. they're 
+	done four at a time, so every coef loaded is used four times, and the 
+	four sums don't wait on each other. the sums add up in the same order 
+	as in dot, so the results are the same
+*/
+static void X(block)(const COEF *RESTRICT p, ptrdiff_t nl, unsigned sym, const REAL *RESTRICT x, ptrdiff_t xs, 
+	REAL *RESTRICT y, ptrdiff_t ys, size_t n)
+{
+	size_t j = 0;
+	for(; j + 4 <= n; j += 4) {
+		const REAL *RESTRICT e0 = x + (ptrdiff_t)j * xs;
+		const REAL *RESTRICT e1 = e0 + xs;
+		const REAL *RESTRICT e2 = e1 + xs;
+		const REAL *RESTRICT e3 = e2 + xs;
+		const REAL *RESTRICT x0 = e0 - nl + 1;
+		const REAL *RESTRICT x1 = e1 - nl + 1;
+		const REAL *RESTRICT x2 = e2 - nl + 1;
+		const REAL *RESTRICT x3 = e3 - nl + 1;
+
+		ACC y0 = 0, y1 = 0, y2 = 0, y3 = 0;
+		switch(sym) {
+		case FSRC_PHASE_PLAIN:
+			for(ptrdiff_t i = 0; i < nl; ++i) {
+				ACC c = p[i];
+				y0 += c * x0[i];
+				y1 += c * x1[i];
+				y2 += c * x2[i];
+				y3 += c * x3[i];
+			}
+			break;
+		case FSRC_PHASE_MIRROR:
+			for(ptrdiff_t i = 0; i < nl; ++i) {
+				ACC c = p[i];
+				y0 += c * e0[-i];
+				y1 += c * e1[-i];
+				y2 += c * e2[-i];
+				y3 += c * e3[-i];
+			}
+			break;
+		default:
+			for(ptrdiff_t i = 0; i < nl / 2; ++i) {
+				ACC c = p[i];
+				y0 += c * ((ACC)x0[i] + e0[-i]);
+				y1 += c * ((ACC)x1[i] + e1[-i]);
+				y2 += c * ((ACC)x2[i] + e2[-i]);
+				y3 += c * ((ACC)x3[i] + e3[-i]);
+			}
+			if(nl & 1) {
+				ACC c = p[nl / 2];
+				y0 += c * x0[nl / 2];
+				y1 += c * x1[nl / 2];
+				y2 += c * x2[nl / 2];
+				y3 += c * x3[nl / 2];
+			}
+		}
+
+		REAL *RESTRICT yj = y + (ptrdiff_t)j * ys;
+		yj[0] = STORE(y0);
+		yj[ys] = STORE(y1);
+		yj[2 * ys] = STORE(y2);
+		yj[3 * ys] = STORE(y3);
+	}
+
+	for(; j < n; ++j)
+		y[(ptrdiff_t)j * ys] = STORE(X(dot)(p, nl, sym, x + (ptrdiff_t)j * xs));
 }
 
 static fsrc_err X(process)(fsrc_stage *s)
@@ -78,8 +184,11 @@ static fsrc_err X(process)(fsrc_stage *s)
 	unsigned L = pps->up;
 	unsigned M = pps->dn;
 
-	/* how many output samples can we produce? */
-	size_t mo = (size_t)((FSRC_DPMUL(sp - sh, L) + M - 1) / M);
+	/* 
+		how many output samples can we produce? output j reads up to input 
+		(j * M + l) / L, which has to be there already
+	*/
+	size_t mo = (size_t)((FSRC_DPMUL(sp - sh, L) - pps->l + M - 1) / M);
 
 	/* how many samples will fit into the output buffer? */
 	size_t ao = ds - dp;
@@ -94,37 +203,47 @@ static fsrc_err X(process)(fsrc_stage *s)
 
 	assert(sn <= sp);
 
-	POLYPHASE *phase = pps->pphs;
+	const unsigned *po = pps->pphs.o;
+	const unsigned *pn = pps->pphs.n;
+	const unsigned *pq = pps->pphs.q;
+	const unsigned *ps = pps->pphs.sym;
+	const REAL *coefs = pps->coefs;
 
 	size_t ch = pps->chans;
 	do {
 		REAL *RESTRICT x = sd + sh;
 		REAL *RESTRICT y = dd + dp;
 
-		unsigned l = pps->l;	
+		unsigned v = pps->pphs.slot[pps->l];	
 
 		ptrdiff_t k = 0;	
-		for(size_t j = 0; j < dn; ++j) {
-			REAL *RESTRICT p = phase[l].p;
-			ptrdiff_t nl = phase[l].n;
-
-			REAL yj = 0;
-			/*for(ptrdiff_t i = 0; i < nl; ++i)
-				yj += p[i] * x[k - i];*/
-
-			/* the subfilter coefs are reversed */
-			REAL *RESTRICT xk = &x[k - nl + 1];
-			for(ptrdiff_t i = 0; i < nl; ++i)
-				yj += p[i] * xk[i];
-
-			y[j] = yj;
-
-			/* look ma, no division! */
-			k += phase[l].q;
-			l = phase[l].r;
+		if(dn >= FSRC_PPS_BLOCK * L) {
+			/* outputs L apart use the same phase, with the input M further on */
+			for(unsigned j = 0; j < L; ++j) {
+				size_t nj = (dn - j + L - 1) / L;
+				X(block)(coefs + po[v], pn[v], ps[v], x + k, M, y + j, L, nj);
+
+				k += pq[v];
+				if(++v == L)
+					v = 0;
+			}
+
+			/* that was one whole cycle */
+			assert(k == (ptrdiff_t)M);
+			k = (ptrdiff_t)sn;
+			v = pps->pphs.slot[lr];
+		} else {
+			for(size_t j = 0; j < dn; ++j) {
+				y[j] = STORE(X(dot)(coefs + po[v], pn[v], ps[v], x + k));
+
+				/* look ma, no division! */
+				k += pq[v];
+				if(++v == L)
+					v = 0;
+			}
 		}
 
-		assert(k == sn && l == lr);
+		assert(k == sn && v == pps->pphs.slot[lr]);
 		memmove(sd, sd + k, (sp - k) * sizeof(REAL));
 
 		sd += ss;
@@ -145,61 +264,212 @@ static void X(reset)(fsrc_stage *s)
 	pps->l = 0;
 }
 
-fsrc_err X(create)(const fsrc_stage_model *ms, fsrc_stage **s, fsrc_iobuf *src, fsrc_iobuf *dst, size_t chans)
+/* the phase is all there is, the history is in the buffers */
+static void X(resume)(fsrc_stage *s, const fsrc_stage *from)
 {
-	static const fsrc_stage_vt vt = {
-		X(destroy),
-		X(process),
-		X(reset)
-	};
+	((X(stage)*)s)->l = ((const X(stage)*)from)->l;
+}
 
-	assert(src->past >= (ms->n + ms->ratio.up - 1) / ms->ratio.up - 1);
+/* output n - 1 reads input ((n - 1) * M + l) / L, see process */
+static size_t X(need)(const fsrc_stage *s, size_t n)
+{
+	const X(stage) *pps = (const X(stage)*)s;
+	if(n == 0)
+		return 0;
 
-	X(stage) *pps = FSRC_NEW(X(stage));
+	return (size_t)((FSRC_DPMUL(n - 1, pps->dn) + pps->l) / pps->up) + 1;
+}
 
-	pps->vt = &vt;
+static size_t X(regions)(const fsrc_stage *s, fsrc_region *r)
+{
+	const X(stage) *pps = (const X(stage)*)s;
+
+	r[0].p = pps;
+	r[0].size = sizeof(X(stage));
+	r[0].tab = 0;
+	r[1].p = 0;
+	r[1].size = 0;
+	r[1].tab = pps->tab;
+
+	return 2;
+}
 
+/* 
+	with a symmetric filter, phase l is phase (N - 1 - l) mod L backwards. 
+	only the first of each pair is stored, the other one is evaluated with 
+	the same coefs, reading the input the other way. a phase paired with 
+	itself is symmetric, so only half of it is stored, and the inputs are 
+	added up in pairs before being multiplied
+*/
+static unsigned X(mirror)(const fsrc_stage_model *ms, unsigned l)
+{
 	unsigned L = ms->ratio.up;
-	unsigned M = ms->ratio.dn;
+	unsigned r = (unsigned)((ms->n - 1) % L);
 
-	pps->up = L;
-	pps->dn = M;
+	if(!(ms->flags & FSRC_SYMMETRIC_FILTER))
+		return l;
 
-	pps->n = ms->n;
+	return (r + L - l) % L;
+}
 
-	pps->l = 0;
+/* the number of coefs stored. it doesn't matter which phase of a pair is */
+static size_t X(stored)(const fsrc_stage_model *ms)
+{
+	unsigned L = ms->ratio.up;
+
+	size_t nc = 0;
+	for(unsigned l = 0; l < L; ++l) {
+		size_t n = (ms->n - l + L - 1) / L;
+		unsigned m = X(mirror)(ms, l);
+		if(m == l)
+			nc += (ms->flags & FSRC_SYMMETRIC_FILTER) ? (n + 1) / 2 : n;
+		else if(m > l)
+			nc += n;
+	}
+
+	return nc;
+}
+
+/* the descriptors' size, padded so the coefs are aligned */
+static size_t X(header)(unsigned L)
+{
+	size_t size = 5 * (size_t)L * sizeof(unsigned);
+	return (size + FSRC_PPS_ALIGN - 1) & ~(size_t)(FSRC_PPS_ALIGN - 1);
+}
+
+/* the phase bank: the descriptors followed by the coefs, in the order of use */
+static fsrc_err X(init_phases)(void *data, const void *arg)
+{
+	const fsrc_stage_model *ms = (const fsrc_stage_model*)arg;
+
+	unsigned L = ms->ratio.up;
+	unsigned M = ms->ratio.dn;
+
+	/* 
+		halfband filters get their own stage, see hbs_src_impl.h. an L-th 
+		band filter with L > 2 would only save the one phase that is a 
+		single tap, 1/L of the work
+	*/
 
-	/* TODO: investigate exploiting L-th band filters */
+	unsigned *po = (unsigned*)data;
+	unsigned *pn = po + L;
+	unsigned *pq = pn + L;
+	unsigned *ps = pq + L;
+	unsigned *slot = ps + L;
+	COEF *p = (COEF*)((char*)data + X(header)(L));
+	size_t o = 0;
 
-	REAL *p = FSRC_ARRAY(REAL, ms->n);
-	POLYPHASE *pphs = FSRC_ARRAY(POLYPHASE, L);
+	/* L and M are coprime, every phase comes up once */
+	for(unsigned v = 0, l = 0; v < L; ++v, l = (l + M) % L)
+		slot[l] = v;
 
 	size_t N = ms->n;
-	double *h = ms->h;
-	for(unsigned l = 0; l < L; ++l) {
+	const double *h = ms->h;
+	for(unsigned v = 0, l = 0; v < L; ++v, l = (l + M) % L) {
 		/*size_t n = 0;		
 		for(size_t k = l; k < N; k += L)
 			p[n++] = h[k] * L;
 		*/
 		size_t n = (N - l + L - 1) / L;
-		for(size_t k = 0; k < n; ++k)
-			p[k] = (REAL)(h[(n - k - 1) * L + l] * L);
+		size_t ns = n;
+
+		/* the one of a pair used later points back */
+		unsigned m = X(mirror)(ms, l);
+		if(m == l && (ms->flags & FSRC_SYMMETRIC_FILTER)) {
+			ps[v] = FSRC_PHASE_FOLDED;
+			ns = (n + 1) / 2;
+		} else if(m != l && slot[m] < v) {
+			ps[v] = FSRC_PHASE_MIRROR;
+			ns = 0;
+		} else {
+			ps[v] = FSRC_PHASE_PLAIN;
+		}
+
+		for(size_t k = 0; k < ns; ++k)
+			p[k] = QUANT(h[(n - k - 1) * L + l] * L);
+
+		po[v] = ns ? (unsigned)o : po[slot[m]];
+		pn[v] = (unsigned)n;
+		pq[v] = (l + M) / L;
+
+		p += ns;
+		o += ns;
+	}
+
+	return FSRC_S_OK;
+}
 
-		pphs[l].p = p;
-		pphs[l].n = n;
+/* what X(create) takes from the heap, the phases are a shared table */
+size_t X(heap)(const fsrc_stage_model *ms, const fsrc_iobuf *src, const fsrc_iobuf *dst)
+{
+	(void)ms;
+	(void)src;
+	(void)dst;
+	return fsrc_heap_need(sizeof(X(stage)));
+}
+
+fsrc_err X(create)(const fsrc_stage_model *ms, fsrc_stage **s, fsrc_iobuf *src, fsrc_iobuf *dst, size_t chans, fsrc_heap *heap)
+{
+	static const fsrc_stage_vt vt = {
+		X(destroy),
+		X(process),
+		X(reset),
+		X(resume),
+		X(need),
+		X(regions)
+	};
+
+	assert(src->past >= (ms->n + ms->ratio.up - 1) / ms->ratio.up - 1);
+
+	X(stage) *pps = FSRC_HEAP_NEW(heap, X(stage));
+	if(!pps)
+		return FSRC_E_NOMEM;
 
-		p += n;
+	pps->vt = &vt;
+
+	unsigned L = ms->ratio.up;
+	unsigned M = ms->ratio.dn;
+
+	pps->up = L;
+	pps->dn = M;
+
+	pps->n = ms->n;
+
+	pps->l = 0;
 
-		pphs[l].q = (l + M) / L;
-		pphs[l].r = (l + M) % L;
+	/* converters with the same stage share the phase bank */
+	fsrc_table_key key;
+	memset(&key, 0, sizeof(key));
+	key.kind = TABLE;
+	key.p[0] = L;
+	key.p[1] = M;
+	key.p[2] = sizeof(COEF);
+	key.p[3] = FSRC_PPS_LAYOUT << 1 | (ms->flags & FSRC_SYMMETRIC_FILTER);
+	key.n = ms->n;
+	key.hash = fsrc_table_hash(ms->h, ms->n);
+	key.h = ms->h;
+
+	const void *pphs;
+	size_t size = X(header)(L) + X(stored)(ms) * sizeof(COEF);
+	fsrc_err err = fsrc_table_get(&pps->tab, &pphs, &key, size, X(init_phases), ms, ms->cache);
+	if(err != FSRC_S_OK) {
+		fsrc_heap_free(heap, pps);
+		return err;
 	}
 
-	pps->pphs = pphs;
+	const unsigned *d = (const unsigned*)pphs;
+	pps->pphs.o = d;
+	pps->pphs.n = d + L;
+	pps->pphs.q = d + 2 * L;
+	pps->pphs.sym = d + 3 * L;
+	pps->pphs.slot = d + 4 * L;
+	pps->coefs = (const COEF*)((const char*)pphs + X(header)(L));
 
 	/*pps->n = ms->n;*/
 	pps->src = src;
 	pps->dst = dst;
 	pps->chans = chans;
+	pps->heap = heap;
 
 	*s = (fsrc_stage*)pps;
 
@@ -207,6 +477,11 @@ fsrc_err X(create)(const fsrc_stage_model *ms, fsrc_stage **s, fsrc_iobuf *src,
 }
 
 #undef REAL 
+#undef COEF
+#undef ACC
+#undef QUANT
+#undef STORE
+#undef TABLE
 #undef POLYPHASE 
 #undef X__
 
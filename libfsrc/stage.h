@@ -22,10 +22,25 @@
 
 typedef struct fsrc_stage fsrc_stage;
 
+/* memory a stage processes with, see fsrc_prepare */
+typedef struct fsrc_region {
+	const void *p;
+	size_t size;
+	struct fsrc_table *tab; /* or a shared table, see tables.h */
+} fsrc_region;
+
+#define FSRC_STAGE_REGIONS 6
+
 typedef struct fsrc_stage_vt {
 	void (*destroy)(fsrc_stage *);
 	fsrc_err (*process)(fsrc_stage *);
 	void (*reset)(fsrc_stage *);
+	/* takes over the state of a stage with the same ratio and another filter */
+	void (*resume)(fsrc_stage *, const fsrc_stage *);
+	/* how many input samples, past the history, it takes for n more outputs */
+	size_t (*need)(const fsrc_stage *, size_t n);
+	/* the memory it processes with, at most FSRC_STAGE_REGIONS. returns how many */
+	size_t (*regions)(const fsrc_stage *, fsrc_region *r);
 } fsrc_stage_vt;
 
 struct fsrc_stage {
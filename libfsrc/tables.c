@@ -0,0 +1,204 @@
+/*    
+	Copyright (C) 2009 Szymon Modzelewski
+
+	This file is part of libfsrc.
+
+    libfsrc is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libfsrc is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libfsrc.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+#include "ifsrc.h"
+#include "tables.h"
+#include "thread.h"
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+
+struct fsrc_table {
+	fsrc_table *next;
+	fsrc_table_key key;
+	unsigned refs;
+	unsigned locks;	/* see fsrc_table_prepare */
+	const void *data;
+	size_t size;
+	fsrc_cache_view *view; /* the data is mapped from a cache if set */
+	double h[1]; /* a copy of the filter, key.h points here */
+};
+
+/* there are only ever a handful, a list will do */
+static fsrc_table *fsrc_tables = 0;
+static fsrc_mutex fsrc_tables_lock = FSRC_MUTEX_INIT;
+
+uint64_t fsrc_table_hash(const double *h, size_t n)
+{
+	/* fnv-1a over whole words, with a shift to mix the high bits back down */
+	uint64_t x = 0xcbf29ce484222325ull;
+	for(size_t i = 0; i < n; ++i) {
+		uint64_t w;
+		memcpy(&w, &h[i], sizeof(w));
+		x = (x ^ w) * 0x100000001b3ull;
+		x ^= x >> 29;
+	}
+	return x;
+}
+
+static int fsrc_table_key_eq(const fsrc_table_key *a, const fsrc_table_key *b)
+{
+	if(a->kind != b->kind || a->n != b->n || a->hash != b->hash)
+		return 0;
+	for(size_t i = 0; i < sizeof(a->p) / sizeof(a->p[0]); ++i) {
+		if(a->p[i] != b->p[i])
+			return 0;
+	}
+	/* the hash only rules filters out */
+	return memcmp(a->h, b->h, a->n * sizeof(double)) == 0;
+}
+
+/* call with the lock held */
+static fsrc_table *fsrc_table_find(const fsrc_table_key *key)
+{
+	for(fsrc_table *t = fsrc_tables; t; t = t->next) {
+		if(fsrc_table_key_eq(&t->key, key)) {
+			++t->refs;
+			return t;
+		}
+	}
+	return 0;
+}
+
+static void fsrc_table_free(fsrc_table *t)
+{
+	if(t->view)
+		ifsrc_cache_view_release(t->view);
+	else
+		fsrc_free((void*)t->data);
+	free(t);
+}
+
+/* finds it in the cache, or builds it and stores it there */
+static fsrc_err fsrc_table_load(fsrc_table *t, size_t size, fsrc_table_init init, const void *arg, fsrc_cache *cache)
+{
+	if(cache && ifsrc_cache_get_table(cache, &t->key, size, &t->data, &t->view) == FSRC_S_OK)
+		return FSRC_S_OK;
+
+	void *data = fsrc_alloc(size);
+	if(!data)
+		return FSRC_E_NOMEM;
+
+	double t0 = fsrc_clock();
+	fsrc_err err = init(data, arg);
+	if(err != FSRC_S_OK) {
+		fsrc_free(data);
+		return err;
+	}
+
+	if(cache)
+		ifsrc_cache_put_table(cache, &t->key, data, size, fsrc_clock() - t0);
+
+	t->data = data;
+
+	return FSRC_S_OK;
+}
+
+fsrc_err fsrc_table_get(fsrc_table **tab, const void **data, const fsrc_table_key *key, size_t size, 
+	fsrc_table_init init, const void *arg, fsrc_cache *cache)
+{
+	fsrc_mutex_lock(&fsrc_tables_lock);
+	fsrc_table *t = fsrc_table_find(key);
+	fsrc_mutex_unlock(&fsrc_tables_lock);
+
+	if(!t) {
+		/* load it unlocked, it can take a while */
+		t = (fsrc_table*)malloc(offsetof(fsrc_table, h) + key->n * sizeof(double));
+		if(!t)
+			return FSRC_E_NOMEM;
+
+		memcpy(t->h, key->h, key->n * sizeof(double));
+		t->key = *key;
+		t->key.h = t->h;
+		t->refs = 1;
+		t->locks = 0;
+		t->data = 0;
+		t->size = size;
+		t->view = 0;
+
+		fsrc_err err = fsrc_table_load(t, size, init, arg, cache);
+		if(err != FSRC_S_OK) {
+			free(t);
+			return err;
+		}
+
+		/* someone else may have loaded it in the meantime */
+		fsrc_mutex_lock(&fsrc_tables_lock);
+		fsrc_table *o = fsrc_table_find(key);
+		if(!o) {
+			t->next = fsrc_tables;
+			fsrc_tables = t;
+		}
+		fsrc_mutex_unlock(&fsrc_tables_lock);
+
+		if(o) {
+			fsrc_table_free(t);
+			t = o;
+		}
+	}
+
+	*tab = t;
+	*data = t->data;
+
+	return FSRC_S_OK;
+}
+
+void fsrc_table_release(fsrc_table *t)
+{
+	if(!t)
+		return;
+
+	fsrc_mutex_lock(&fsrc_tables_lock);
+	int last = --t->refs == 0;
+	if(last) {
+		fsrc_table **p = &fsrc_tables;
+		while(*p != t)
+			p = &(*p)->next;
+		*p = t->next;
+	}
+	fsrc_mutex_unlock(&fsrc_tables_lock);
+
+	if(last)
+		fsrc_table_free(t);
+}
+
+fsrc_err fsrc_table_prepare(fsrc_table *t, int lock)
+{
+	fsrc_mem_touch(t->data, t->size, 0);
+	if(!lock)
+		return FSRC_S_OK;
+
+	fsrc_err err = FSRC_S_OK;
+	fsrc_mutex_lock(&fsrc_tables_lock);
+	if(t->locks == 0 && fsrc_mem_lock(t->data, t->size))
+		err = FSRC_E_NORSRC;
+	else
+		++t->locks;
+	fsrc_mutex_unlock(&fsrc_tables_lock);
+
+	return err;
+}
+
+void fsrc_table_unlock(fsrc_table *t)
+{
+	fsrc_mutex_lock(&fsrc_tables_lock);
+	if(--t->locks == 0)
+		fsrc_mem_unlock(t->data, t->size);
+	fsrc_mutex_unlock(&fsrc_tables_lock);
+}
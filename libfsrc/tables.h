@@ -0,0 +1,76 @@
+/*    
+	Copyright (C) 2009 Szymon Modzelewski
+
+	This file is part of libfsrc.
+
+    libfsrc is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libfsrc is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libfsrc.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+#ifndef FSRC_TABLES_H
+#define FSRC_TABLES_H
+
+#include "design.h"
+
+/*
+	process-wide registry of the tables stages derive from their filters 
+	(polyphase banks, filter spectra), so converters built from the same 
+	filter share one copy. tables are reference counted and immutable once 
+	built. given a cache, they're also looked up there, and used in place
+	from its mapping, before being built and stored
+*/
+
+enum {
+	FSRC_TABLE_PPS,
+	FSRC_TABLE_OLS,
+	FSRC_TABLE_IPS	/* fixed point polyphase */
+};
+
+typedef struct fsrc_table_key {
+	int kind;
+	size_t p[4];	/* layout parameters, unused ones zero */
+	size_t n;		/* filter length */
+	uint64_t hash;	/* of the filter coefficients */
+	const double *h;	/* the coefficients, compared when the hash matches */
+} fsrc_table_key;
+
+typedef struct fsrc_table fsrc_table;
+
+/* fills in the table. data is fsrc_alloc aligned */
+typedef fsrc_err (*fsrc_table_init)(void *data, const void *arg);
+
+uint64_t fsrc_table_hash(const double *h, size_t n);
+
+/*
+	returns the table for key, building it with init(data, arg) if there's 
+	none. the data must not be modified. release it with fsrc_table_release.
+	cache is optional
+*/
+fsrc_err fsrc_table_get(fsrc_table **tab, const void **data, const fsrc_table_key *key, size_t size, 
+	fsrc_table_init init, const void *arg, fsrc_cache *cache);
+
+void fsrc_table_release(fsrc_table *tab);
+
+/* 
+	faults the table in, for fsrc_prepare. with lock, it's locked in memory 
+	until as many fsrc_table_unlock calls, converters sharing it count
+*/
+fsrc_err fsrc_table_prepare(fsrc_table *tab, int lock);
+void fsrc_table_unlock(fsrc_table *tab);
+
+/* the persistent side, in cache.c */
+fsrc_err ifsrc_cache_get_table(fsrc_cache *cache, const fsrc_table_key *key, size_t size, const void **data, fsrc_cache_view **view);
+fsrc_err ifsrc_cache_put_table(fsrc_cache *cache, const fsrc_table_key *key, const void *data, size_t size, double cost);
+void ifsrc_cache_view_release(fsrc_cache_view *view);
+
+#endif
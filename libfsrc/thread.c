@@ -0,0 +1,238 @@
+/*    
+	Copyright (C) 2009 Szymon Modzelewski
+
+	This file is part of libfsrc.
+
+    libfsrc is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libfsrc is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libfsrc.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+#include "ifsrc.h"
+#include "thread.h"
+#include <stdlib.h>
+#include <time.h>
+
+#if defined(_WIN32)
+
+#include <windows.h>
+#include <process.h>
+
+fsrc_err fsrc_mutex_init(fsrc_mutex *m)
+{
+	*m = 0;
+	return FSRC_S_OK;
+}
+
+void fsrc_mutex_destroy(fsrc_mutex *m)
+{
+}
+
+void fsrc_mutex_lock(fsrc_mutex *m)
+{
+	/* only used around short, infrequent sections */
+	while(InterlockedCompareExchange(m, 1, 0))
+		Sleep(0);
+}
+
+int fsrc_mutex_trylock(fsrc_mutex *m)
+{
+	return !InterlockedCompareExchange(m, 1, 0);
+}
+
+void fsrc_mutex_unlock(fsrc_mutex *m)
+{
+	InterlockedExchange(m, 0);
+}
+
+struct fsrc_thread_s {
+	HANDLE h;
+	fsrc_thread_proc proc;
+	void *arg;
+};
+
+static unsigned __stdcall fsrc_thread_start(void *arg)
+{
+	fsrc_thread t = (fsrc_thread)arg;
+	t->proc(t->arg);
+	return 0;
+}
+
+fsrc_err fsrc_thread_create(fsrc_thread *out, fsrc_thread_proc proc, void *arg)
+{
+	fsrc_thread t = FSRC_NEW(struct fsrc_thread_s);
+	if(!t)
+		return FSRC_E_NOMEM;
+
+	t->proc = proc;
+	t->arg = arg;
+	t->h = (HANDLE)_beginthreadex(0, 0, fsrc_thread_start, t, 0, 0);
+	if(!t->h) {
+		free(t);
+		return FSRC_E_NORSRC;
+	}
+
+	*out = t;
+	return FSRC_S_OK;
+}
+
+void fsrc_thread_join(fsrc_thread t)
+{
+	WaitForSingleObject(t->h, INFINITE);
+	CloseHandle(t->h);
+	free(t);
+}
+
+unsigned fsrc_thread_count(void)
+{
+	SYSTEM_INFO si;
+	GetSystemInfo(&si);
+	return si.dwNumberOfProcessors ? (unsigned)si.dwNumberOfProcessors : 1;
+}
+
+double fsrc_clock(void)
+{
+	LARGE_INTEGER c, f;
+	QueryPerformanceCounter(&c);
+	QueryPerformanceFrequency(&f);
+	return (double)c.QuadPart / f.QuadPart;
+}
+
+#elif !defined(FSRC_NO_THREADS)
+
+#include <unistd.h>
+
+fsrc_err fsrc_mutex_init(fsrc_mutex *m)
+{
+	return pthread_mutex_init(m, 0) ? FSRC_E_NORSRC : FSRC_S_OK;
+}
+
+void fsrc_mutex_destroy(fsrc_mutex *m)
+{
+	pthread_mutex_destroy(m);
+}
+
+void fsrc_mutex_lock(fsrc_mutex *m)
+{
+	pthread_mutex_lock(m);
+}
+
+int fsrc_mutex_trylock(fsrc_mutex *m)
+{
+	return pthread_mutex_trylock(m) == 0;
+}
+
+void fsrc_mutex_unlock(fsrc_mutex *m)
+{
+	pthread_mutex_unlock(m);
+}
+
+struct fsrc_thread_s {
+	pthread_t t;
+	fsrc_thread_proc proc;
+	void *arg;
+};
+
+static void *fsrc_thread_start(void *arg)
+{
+	fsrc_thread t = (fsrc_thread)arg;
+	t->proc(t->arg);
+	return 0;
+}
+
+fsrc_err fsrc_thread_create(fsrc_thread *out, fsrc_thread_proc proc, void *arg)
+{
+	fsrc_thread t = FSRC_NEW(struct fsrc_thread_s);
+	if(!t)
+		return FSRC_E_NOMEM;
+
+	t->proc = proc;
+	t->arg = arg;
+	if(pthread_create(&t->t, 0, fsrc_thread_start, t)) {
+		free(t);
+		return FSRC_E_NORSRC;
+	}
+
+	*out = t;
+	return FSRC_S_OK;
+}
+
+void fsrc_thread_join(fsrc_thread t)
+{
+	pthread_join(t->t, 0);
+	free(t);
+}
+
+unsigned fsrc_thread_count(void)
+{
+#ifdef _SC_NPROCESSORS_ONLN
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	if(n > 0)
+		return (unsigned)n;
+#endif
+	return 1;
+}
+
+double fsrc_clock(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+#else
+
+fsrc_err fsrc_mutex_init(fsrc_mutex *m)
+{
+	*m = 0;
+	return FSRC_S_OK;
+}
+
+void fsrc_mutex_destroy(fsrc_mutex *m)
+{
+}
+
+void fsrc_mutex_lock(fsrc_mutex *m)
+{
+}
+
+int fsrc_mutex_trylock(fsrc_mutex *m)
+{
+	return 1;
+}
+
+void fsrc_mutex_unlock(fsrc_mutex *m)
+{
+}
+
+fsrc_err fsrc_thread_create(fsrc_thread *out, fsrc_thread_proc proc, void *arg)
+{
+	proc(arg);
+	*out = 0;
+	return FSRC_S_OK;
+}
+
+void fsrc_thread_join(fsrc_thread t)
+{
+}
+
+unsigned fsrc_thread_count(void)
+{
+	return 1;
+}
+
+double fsrc_clock(void)
+{
+	return (double)clock() / CLOCKS_PER_SEC;
+}
+
+#endif
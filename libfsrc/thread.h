@@ -0,0 +1,72 @@
+/*    
+	Copyright (C) 2009 Szymon Modzelewski
+
+	This file is part of libfsrc.
+
+    libfsrc is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libfsrc is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libfsrc.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+#ifndef FSRC_THREAD_H
+#define FSRC_THREAD_H
+
+/*
+	the bare minimum needed to run filter designs concurrently.
+	without thread support, fsrc_thread_create runs the procedure right away
+*/
+
+#if defined(_WIN32)
+
+typedef volatile long fsrc_mutex;
+#define FSRC_MUTEX_INIT 0
+
+#elif defined(HAVE_PTHREAD_H)
+
+#include <pthread.h>
+
+typedef pthread_mutex_t fsrc_mutex;
+#define FSRC_MUTEX_INIT PTHREAD_MUTEX_INITIALIZER
+
+#else
+
+#define FSRC_NO_THREADS
+
+typedef int fsrc_mutex;
+#define FSRC_MUTEX_INIT 0
+
+#endif
+
+/* FSRC_MUTEX_INIT is for static mutexes only, others are initialised here */
+fsrc_err fsrc_mutex_init(fsrc_mutex *m);
+void fsrc_mutex_destroy(fsrc_mutex *m);
+
+void fsrc_mutex_lock(fsrc_mutex *m);
+/* returns 0 if it's held, instead of waiting */
+int fsrc_mutex_trylock(fsrc_mutex *m);
+void fsrc_mutex_unlock(fsrc_mutex *m);
+
+typedef struct fsrc_thread_s *fsrc_thread;
+typedef void (*fsrc_thread_proc)(void *arg);
+
+fsrc_err fsrc_thread_create(fsrc_thread *thread, fsrc_thread_proc proc, void *arg);
+
+/* waits for the thread to finish and releases it */
+void fsrc_thread_join(fsrc_thread thread);
+
+/* how many threads can usefully run at once, at least 1 */
+unsigned fsrc_thread_count(void);
+
+/* seconds on a monotonic clock, for timing things */
+double fsrc_clock(void);
+
+#endif
@@ -48,6 +48,7 @@ struct toep_pcg {
 	double *d;
 
 	int s; /* symmetry */
+	int x0; /* warm start */
 };
 
 #define PCG_INIT_CHECK(a) if(!(a)) { toep_pcg_destroy(pcg); return 0; } else (void)0
@@ -79,6 +80,7 @@ toep_pcg *toep_pcg_init(size_t N, int opt)
 	pcg->N = N;
 	pcg->M = M;
 	pcg->s = sym;
+	pcg->x0 = (opt & PCG_TOEP_OPT_X0) != 0;
 
 	int sflags = 0;
 	if(opt & PCG_TOEP_OPT_SOLVE)
@@ -292,13 +294,23 @@ unsigned toep_pcg_solve(toep_pcg *pcg, double *gev, double *ev, double *b, doubl
 	assert(maxit > 0 && tol > 0);
 
 	memcpy(r, b, N * sizeof(double));
-	memset(u, 0, N * sizeof(double));
 	memset(d, 0, N * sizeof(double));
 
-	double t1 = 1;
-
 	tol *= fsrc_dnrm2(N, r);
 
+	if(pcg->x0) {
+		/* r = b - Tu */
+		memcpy(z, u, N * sizeof(double));
+		pcg_fcc(N, pcg->M2, pcg->dft2, pcg->idft2, z, pcg->Y, gev, pcg->s);
+		fsrc_dxmy(N, z, r);
+		if(fsrc_dnrm2(N, r) <= tol)
+			return 0;
+	} else {
+		memset(u, 0, N * sizeof(double));
+	}
+
+	double t1 = 1;
+
 	unsigned n = 0;
 	do {
 		memcpy(z, r, N * sizeof(double));
@@ -32,6 +32,7 @@ enum {
 
 #define PCG_TOEP_OPT_SOLVE	(1 << 5)
 #define PCG_TOEP_OPT_EIGEN	(1 << 6)
+#define PCG_TOEP_OPT_X0		(1 << 7) /* toep_pcg_solve starts from the contents of x */
 
 toep_pcg *toep_pcg_init(size_t N, int opt);
 
@@ -0,0 +1,502 @@
+/*    
+	Copyright (C) 2009 Szymon Modzelewski
+
+	This file is part of libfsrc.
+
+    libfsrc is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libfsrc is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libfsrc.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+/*
+	design cache checks, each on a fresh cache in a directory of its own
+*/
+#include <fsrc.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#define CACHE_MODE S_IRUSR | S_IWUSR
+
+/* two directories, for the checks that need two caches */
+static char paths[2][32] = { "fsrc-cache-XXXXXX", "fsrc-cache-XXXXXX" };
+
+static fsrc_cache *open_cache(int i)
+{
+	fsrc_cache *cache;
+	fsrc_err err = fsrc_cache_create_dir(&cache, paths[i], CACHE_MODE, 1);
+	if(err != FSRC_S_OK) {
+		printf("fsrc_cache_create_dir failed (%d)\n", err);
+		return 0;
+	}
+	return cache;
+}
+
+static void remove_cache(int i)
+{
+	DIR *d = opendir(paths[i]);
+	if(!d)
+		return;
+
+	struct dirent *e;
+	char name[sizeof(paths[i]) + 256];
+	while((e = readdir(d)) != 0) {
+		if(strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0)
+			continue;
+		snprintf(name, sizeof(name), "%s/%s", paths[i], e->d_name);
+		unlink(name);
+	}
+	closedir(d);
+}
+
+static fsrc_stats stats(fsrc_cache *cache)
+{
+	fsrc_stats st;
+	memset(&st, 0, sizeof(st));
+	fsrc_cache_stats(cache, &st);
+	return st;
+}
+
+static fsrc_spec load_spec(fsrc_ull irate, fsrc_ull orate, fsrc_preset pre, int flags)
+{
+	fsrc_ratio r;
+	fsrc_spec spec;
+
+	fsrc_freq_ratio(irate, orate, &r);
+	fsrc_load_preset(r, pre, &spec);
+	spec.isize = 4096;
+	spec.osize = 4096;
+	spec.flags = flags;
+
+	return spec;
+}
+
+static fsrc_err create_spec(fsrc_cache *cache, fsrc_spec spec)
+{
+	fsrc_converter *src;
+	fsrc_err err = fsrc_create(cache, &src, &spec, 1);
+	if(err == FSRC_S_OK)
+		fsrc_destroy(src);
+
+	return err;
+}
+
+static fsrc_err create(fsrc_cache *cache, fsrc_ull irate, fsrc_ull orate, fsrc_preset pre, int flags)
+{
+	return create_spec(cache, load_spec(irate, orate, pre, flags));
+}
+
+#define INPUT 8192
+
+/* converts INPUT samples of noise, out has to hold what that makes */
+static size_t convert(fsrc_cache *cache, fsrc_spec spec, double *out)
+{
+	fsrc_converter *src;
+	if(fsrc_create(cache, &src, &spec, 1) != FSRC_S_OK)
+		return 0;
+
+	static double in[INPUT];
+	unsigned seed = 1;
+	for(size_t i = 0; i < INPUT; ++i) {
+		seed = seed * 1103515245 + 12345;
+		in[i] = (seed >> 16) / 65536.0 - 0.5;
+	}
+
+	size_t pos = 0, size = 0;
+	for(;;) {
+		fsrc_bufdesc d = { 0 };
+		d.fmt = fsrc_f64;
+		if(pos < INPUT) {
+			d.size = INPUT - pos;
+			d.data = in + pos;
+			pos += fsrc_read(src, &d);
+			if(pos == INPUT)
+				fsrc_end(src);
+		}
+		if(fsrc_process(src) == FSRC_S_END)
+			break;
+		d.size = 4096;
+		d.data = out + size;
+		size += fsrc_write(src, &d);
+	}
+
+	fsrc_destroy(src);
+
+	return size;
+}
+
+/* 
+	designs already in the cache are used as warm starts for ones near 
+	them. fixed and fft stages decompose the same ratio differently, so 
+	this has the fft design start from a neighbouring fixed one
+*/
+static int check_neighbour(void)
+{
+	fsrc_cache *cache = open_cache(0);
+	if(!cache)
+		return 0;
+
+	fsrc_err a = create(cache, 44100, 96000, FSRC_HQ_24, FSRC_FIXED);
+	fsrc_err b = create(cache, 44100, 96000, FSRC_HQ_24, FSRC_USE_FFT);
+	fsrc_cache_destroy(cache);
+
+	int ok = a == FSRC_S_OK && b == FSRC_S_OK;
+	printf("neighbour: %d %d, %s\n", a, b, ok ? "ok" : "FAILED");
+	return ok;
+}
+
+/* 
+	a second cache object on the same directory finds what the first one 
+	designed through its mapping, and maps the index again once it's grown
+*/
+static int check_shared(void)
+{
+	fsrc_cache *a = open_cache(0);
+	fsrc_cache *b = open_cache(0);
+	int ok = a && b;
+
+	if(ok) {
+		ok &= create(a, 44100, 22050, FSRC_MQ_16, 0) == FSRC_S_OK;
+		fsrc_stats sa = stats(a);
+		ok &= create(b, 44100, 22050, FSRC_MQ_16, 0) == FSRC_S_OK;
+		fsrc_stats sb = stats(b);
+		ok &= sa.misses > 0 && sb.hits == sa.misses && sb.misses == 0;
+
+		/* b has the index mapped now, a adds to it */
+		ok &= create(a, 44100, 48000, FSRC_MQ_16, 0) == FSRC_S_OK;
+		ok &= create(b, 44100, 48000, FSRC_MQ_16, 0) == FSRC_S_OK;
+		fsrc_stats sb2 = stats(b);
+		ok &= sb2.misses == 0 && sb2.hits > sb.hits;
+	}
+
+	if(b)
+		fsrc_cache_destroy(b);
+	if(a)
+		fsrc_cache_destroy(a);
+
+	printf("shared: %s\n", ok ? "ok" : "FAILED");
+	return ok;
+}
+
+typedef struct import_arg {
+	fsrc_cache *dst;
+	fsrc_cache *src;
+	int ok;
+} import_arg;
+
+#define IMPORTS 2000
+
+static void *import_proc(void *p)
+{
+	import_arg *arg = (import_arg*)p;
+	for(int i = 0; i < IMPORTS; ++i)
+		arg->ok &= fsrc_cache_import(arg->dst, arg->src) == FSRC_S_OK;
+	return 0;
+}
+
+/* 
+	importing a cache into itself through another object leaves it as it 
+	is, imports bring over everything, and two the opposite way at the 
+	same time don't deadlock
+*/
+static int check_import(void)
+{
+	fsrc_cache *a = open_cache(0);
+	fsrc_cache *a2 = open_cache(0);
+	fsrc_cache *b = open_cache(1);
+	int ok = a && a2 && b;
+
+	if(ok) {
+		ok &= create(a, 44100, 22050, FSRC_MQ_16, 0) == FSRC_S_OK;
+		fsrc_stats sa = stats(a);
+		ok &= fsrc_cache_import(a, a2) == FSRC_S_OK;
+		fsrc_stats sa2 = stats(a);
+		ok &= sa.entries > 0 && sa2.entries == sa.entries && sa2.bytes == sa.bytes;
+
+		ok &= fsrc_cache_import(b, a) == FSRC_S_OK;
+		ok &= stats(b).entries == sa.entries;
+		ok &= create(b, 44100, 22050, FSRC_MQ_16, 0) == FSRC_S_OK;
+		ok &= stats(b).misses == 0;
+
+		ok &= create(b, 44100, 48000, FSRC_MQ_16, 0) == FSRC_S_OK;
+		import_arg ab = { b, a, 1 }, ba = { a, b, 1 };
+		pthread_t t;
+		if(pthread_create(&t, 0, import_proc, &ab) == 0) {
+			import_proc(&ba);
+			pthread_join(t, 0);
+			ok &= ab.ok && ba.ok;
+		} else {
+			ok = 0;
+		}
+		ok &= stats(a).entries == stats(b).entries;
+	}
+
+	if(b)
+		fsrc_cache_destroy(b);
+	if(a2)
+		fsrc_cache_destroy(a2);
+	if(a)
+		fsrc_cache_destroy(a);
+
+	printf("import: %s\n", ok ? "ok" : "FAILED");
+	return ok;
+}
+
+/* 
+	designs from two cache objects are appended to the same index, a third 
+	one finds all of them, before and after it's compacted
+*/
+static int check_append(void)
+{
+	static const fsrc_ull rates[] = { 22050, 11025, 48000 };
+	fsrc_cache *a = open_cache(0);
+	fsrc_cache *b = open_cache(0);
+	fsrc_cache *c = open_cache(0);
+	int ok = a && b && c;
+
+	if(ok) {
+		for(size_t i = 0; i < sizeof(rates) / sizeof(rates[0]); ++i)
+			ok &= create(i & 1 ? b : a, 44100, rates[i], FSRC_MQ_16, 0) == FSRC_S_OK;
+		fsrc_ull made = stats(a).misses + stats(b).misses;
+		fsrc_stats sc = stats(c);
+		ok &= sc.entries > 0 && sc.entries <= made;
+
+		for(int k = 0; k < 2; ++k) {
+			fsrc_ull hits = stats(c).hits;
+			for(size_t i = 0; i < sizeof(rates) / sizeof(rates[0]); ++i)
+				ok &= create(c, 44100, rates[i], FSRC_MQ_16, 0) == FSRC_S_OK;
+			fsrc_stats st = stats(c);
+			ok &= st.misses == 0 && st.hits - hits == made && st.entries == sc.entries;
+			ok &= fsrc_cache_compact(c) == FSRC_S_OK;
+		}
+	}
+
+	if(c)
+		fsrc_cache_destroy(c);
+	if(b)
+		fsrc_cache_destroy(b);
+	if(a)
+		fsrc_cache_destroy(a);
+
+	printf("append: %s\n", ok ? "ok" : "FAILED");
+	return ok;
+}
+
+/* flips a bit in the index file, at off */
+static int corrupt(int i, long off)
+{
+	char name[sizeof(paths[i]) + 16];
+	snprintf(name, sizeof(name), "%s/lpf.idx", paths[i]);
+
+	FILE *f = fopen(name, "r+b");
+	if(!f)
+		return 0;
+
+	int ok = fseek(f, off, SEEK_SET) == 0;
+	int c = ok ? fgetc(f) : EOF;
+	ok = c != EOF && fseek(f, off, SEEK_SET) == 0 && fputc(c ^ 0x40, f) != EOF;
+	fclose(f);
+
+	return ok;
+}
+
+/* 
+	an entry that fails its checksum is ignored, designed again, and its 
+	space is reclaimed by compaction. the index header is 32 bytes, 
+	the first entry's key follows
+*/
+static int check_checksum(void)
+{
+	fsrc_cache *cache = open_cache(0);
+	int ok = cache != 0;
+	if(ok) {
+		ok &= create(cache, 44100, 22050, FSRC_MQ_16, 0) == FSRC_S_OK;
+		ok &= stats(cache).entries == 1;
+		fsrc_cache_destroy(cache);
+	}
+
+	ok &= corrupt(0, 48);
+
+	cache = ok ? open_cache(0) : 0;
+	if(cache) {
+		fsrc_stats st = stats(cache);
+		ok &= st.entries == 0;
+		ok &= create(cache, 44100, 22050, FSRC_MQ_16, 0) == FSRC_S_OK;
+		fsrc_stats st2 = stats(cache);
+		ok &= st2.hits == 0 && st2.misses == 1 && st2.entries == 1;
+		ok &= fsrc_cache_compact(cache) == FSRC_S_OK;
+		fsrc_stats st3 = stats(cache);
+		ok &= st3.entries == 1 && st3.bytes < st2.bytes;
+		fsrc_cache_destroy(cache);
+	} else {
+		ok = 0;
+	}
+
+	printf("checksum: %s\n", ok ? "ok" : "FAILED");
+	return ok;
+}
+
+/* 
+	symmetric filters are stored half, and halfbands as they are. either 
+	way, what's read back converts exactly as what was designed
+*/
+static int check_round_trip(void)
+{
+	static const fsrc_ull rates[] = { 48000, 4 * 44100 };
+	static const int flags[] = { 0, FSRC_DOUBLE, FSRC_CACHE_TABLES };
+	static double ref[8 * INPUT], out[8 * INPUT];
+
+	int ok = 1;
+	for(size_t i = 0; i < sizeof(rates) / sizeof(rates[0]); ++i) {
+		for(size_t j = 0; j < sizeof(flags) / sizeof(flags[0]); ++j) {
+			fsrc_spec spec = load_spec(44100, rates[i], FSRC_MQ_16, flags[j]);
+			size_t n = convert(0, spec, ref);
+
+			/* stored by the first, read back by the second */
+			for(int k = 0; k < 2; ++k) {
+				fsrc_cache *cache = open_cache(0);
+				if(!cache)
+					return 0;
+				size_t m = convert(cache, spec, out);
+				fsrc_stats st = stats(cache);
+				fsrc_cache_destroy(cache);
+
+				ok &= n > 0 && m == n && memcmp(ref, out, n * sizeof(double)) == 0;
+				ok &= k ? st.misses == 0 && st.hits > 0 : st.misses > 0;
+			}
+			remove_cache(0);
+		}
+	}
+
+	printf("round trip: %s\n", ok ? "ok" : "FAILED");
+	return ok;
+}
+
+#define LIMIT 16384
+
+/* 
+	with a limit well above what any one converter's filters take, the 
+	cache stays under it as designs are added, by evicting older ones. 
+	the limit is kept in the cache, and hits count what they saved
+*/
+static int check_evict(void)
+{
+	static const fsrc_ull rates[] = { 22050, 11025, 48000, 8000, 16000, 88200, 14700 };
+	fsrc_cache *a = open_cache(0);
+	fsrc_cache *b = open_cache(0);
+	int ok = a && b;
+
+	if(ok) {
+		ok &= fsrc_cache_set_limit(a, LIMIT) == FSRC_S_OK;
+		ok &= stats(b).limit == LIMIT;
+
+		for(size_t i = 0; i < sizeof(rates) / sizeof(rates[0]); ++i) {
+			ok &= create(a, 44100, rates[i], FSRC_MQ_16, 0) == FSRC_S_OK;
+			ok &= stats(a).bytes <= LIMIT;
+		}
+		fsrc_stats st = stats(a);
+		ok &= st.entries < st.misses && st.hits == 0 && st.saved == 0;
+
+		/* the one just made is still there */
+		ok &= create(b, 44100, rates[sizeof(rates) / sizeof(rates[0]) - 1], FSRC_MQ_16, 0) == FSRC_S_OK;
+		fsrc_stats sb = stats(b);
+		ok &= sb.hits > 0 && sb.misses == 0 && sb.saved > 0;
+
+		ok &= fsrc_cache_set_limit(b, 0) == FSRC_S_OK;
+		ok &= stats(a).limit == 0;
+	}
+
+	if(b)
+		fsrc_cache_destroy(b);
+	if(a)
+		fsrc_cache_destroy(a);
+
+	printf("evict: %s\n", ok ? "ok" : "FAILED");
+	return ok;
+}
+
+/* 
+	a spec that isn't cached is met by a cached design to a slightly 
+	stricter one, which is used as it is. one that's stricter than what's 
+	cached isn't
+*/
+static int check_stricter(void)
+{
+	static double ref[2 * INPUT], out[2 * INPUT];
+
+	fsrc_spec strict = load_spec(44100, 48000, FSRC_MQ_16, 0);
+	fsrc_spec loose = strict;
+	loose.dp *= 1.05;
+	loose.ds *= 1.05;
+
+	size_t n = convert(0, strict, ref);
+
+	fsrc_cache *cache = open_cache(0);
+	if(!cache)
+		return 0;
+
+	int ok = create_spec(cache, strict) == FSRC_S_OK;
+	fsrc_stats st = stats(cache);
+
+	size_t m = convert(cache, loose, out);
+	fsrc_stats st2 = stats(cache);
+	ok &= st2.hits - st.hits == st.misses && st2.misses == st.misses && st2.entries == st.entries;
+	ok &= n > 0 && m == n && memcmp(ref, out, n * sizeof(double)) == 0;
+
+	fsrc_spec stricter = strict;
+	stricter.ds /= 1.05;
+	ok &= create_spec(cache, stricter) == FSRC_S_OK;
+	ok &= stats(cache).misses > st2.misses;
+
+	fsrc_cache_destroy(cache);
+
+	printf("stricter: %s\n", ok ? "ok" : "FAILED");
+	return ok;
+}
+
+int main()
+{
+	static int (*const checks[])(void) = {
+		check_neighbour,
+		check_shared,
+		check_import,
+		check_append,
+		check_checksum,
+		check_round_trip,
+		check_evict,
+		check_stricter,
+	};
+
+	for(int i = 0; i < 2; ++i) {
+		if(!mkdtemp(paths[i])) {
+			perror("mkdtemp");
+			return EXIT_FAILURE;
+		}
+	}
+
+	int ok = 1;
+	for(size_t i = 0; i < sizeof(checks) / sizeof(checks[0]); ++i) {
+		ok &= checks[i]();
+		remove_cache(0);
+		remove_cache(1);
+	}
+
+	rmdir(paths[0]);
+	rmdir(paths[1]);
+
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
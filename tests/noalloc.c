@@ -0,0 +1,215 @@
+/*    
+	Copyright (C) 2009 Szymon Modzelewski
+
+	This file is part of libfsrc.
+
+    libfsrc is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libfsrc is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libfsrc.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+/*
+	checks that a prepared converter doesn't allocate or take locks. 
+	malloc, free and pthread_mutex_lock are interposed, and any call to 
+	them between fsrc_prepare and fsrc_destroy fails the test
+*/
+#define _GNU_SOURCE
+#include <fsrc.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <dlfcn.h>
+#include <pthread.h>
+
+static int armed;
+static int calls;
+
+static void *(*next_malloc)(size_t);
+static void *(*next_calloc)(size_t, size_t);
+static void *(*next_realloc)(void *, size_t);
+static void (*next_free)(void *);
+static int (*next_lock)(pthread_mutex_t *);
+
+/* dlsym may allocate before the real ones are known */
+static char boot[4096];
+static size_t boot_used;
+
+static int resolving;
+
+static void resolve(void)
+{
+	if(next_malloc || resolving)
+		return;
+	resolving = 1;
+	next_calloc = dlsym(RTLD_NEXT, "calloc");
+	next_realloc = dlsym(RTLD_NEXT, "realloc");
+	next_free = dlsym(RTLD_NEXT, "free");
+	next_lock = dlsym(RTLD_NEXT, "pthread_mutex_lock");
+	next_malloc = dlsym(RTLD_NEXT, "malloc");
+	resolving = 0;
+}
+
+static void *boot_alloc(size_t size)
+{
+	size = (size + 15) & ~(size_t)15;
+	if(boot_used + size > sizeof(boot))
+		return 0;
+	void *p = boot + boot_used;
+	boot_used += size;
+	return p;
+}
+
+void *malloc(size_t size)
+{
+	resolve();
+	if(!next_malloc)
+		return boot_alloc(size);
+	calls += armed;
+	return next_malloc(size);
+}
+
+void *calloc(size_t n, size_t size)
+{
+	resolve();
+	if(!next_calloc)
+		return boot_alloc(n * size); /* static, so already zeroed */
+	calls += armed;
+	return next_calloc(n, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	resolve();
+	calls += armed;
+	return next_realloc(ptr, size);
+}
+
+void free(void *ptr)
+{
+	if((char *)ptr >= boot && (char *)ptr < boot + sizeof(boot))
+		return;
+	resolve();
+	calls += armed;
+	if(ptr)
+		next_free(ptr);
+}
+
+int pthread_mutex_lock(pthread_mutex_t *mutex)
+{
+	resolve();
+	calls += armed;
+	return next_lock(mutex);
+}
+
+#define CHANS	2
+#define BLOCK	1000
+#define INPUT	20000
+
+static const fsrc_fmt formats[] = { fsrc_ui8, fsrc_i16, fsrc_i32, fsrc_f32, fsrc_f64 };
+
+static double ibuf[BLOCK * CHANS];
+static double obuf[4 * BLOCK * CHANS];
+
+/* one stream through read, process and write, then reset */
+static int run(fsrc_converter *src, fsrc_fmt fmt)
+{
+	size_t pos = 0;
+	int ended = 0;
+
+	for(;;) {
+		if(pos < INPUT) {
+			fsrc_bufdesc in = { 0 };
+			in.size = INPUT - pos < BLOCK ? INPUT - pos : BLOCK;
+			in.data = ibuf;
+			in.fmt = fmt;
+			pos += fsrc_read(src, &in);
+		} else if(!ended) {
+			fsrc_end(src);
+			ended = 1;
+		}
+
+		fsrc_err err = fsrc_process(src);
+		if(err == FSRC_S_END)
+			break;
+		if(err < 0)
+			return 0;
+
+		fsrc_bufdesc out = { 0 };
+		out.size = 4 * BLOCK;
+		out.data = obuf;
+		out.fmt = fmt;
+		fsrc_write(src, &out);
+	}
+
+	fsrc_reset(src);
+
+	return 1;
+}
+
+static int check(const char *name, fsrc_ull irate, fsrc_ull orate, int flags)
+{
+	fsrc_ratio r;
+	fsrc_spec spec;
+	fsrc_converter *src;
+
+	fsrc_freq_ratio(irate, orate, &r);
+	fsrc_load_preset(r, FSRC_MQ_16, &spec);
+	spec.isize = BLOCK;
+	spec.osize = BLOCK;
+	spec.flags = flags;
+
+	fsrc_err err = fsrc_create(0, &src, &spec, CHANS);
+	if(err != FSRC_S_OK) {
+		printf("%s: fsrc_create failed (%d)\n", name, err);
+		return 0;
+	}
+
+	err = fsrc_prepare(src, 0);
+	if(err != FSRC_S_OK) {
+		printf("%s: fsrc_prepare failed (%d)\n", name, err);
+		fsrc_destroy(src);
+		return 0;
+	}
+
+	int ok = 1;
+
+	for(size_t i = 0; i < sizeof(formats) / sizeof(formats[0]); ++i) {
+		memset(ibuf, 0, sizeof(ibuf));
+		calls = 0;
+		armed = 1;
+		int done = run(src, formats[i]);
+		armed = 0;
+		if(!done || calls) {
+			printf("%s: format %d: %s, %d calls\n", name, (int)formats[i], done ? "ok" : "failed", calls);
+			ok = 0;
+		}
+	}
+
+	fsrc_destroy(src);
+
+	printf("%s: %s\n", name, ok ? "ok" : "FAILED");
+
+	return ok;
+}
+
+int main()
+{
+	int ok = 1;
+
+	ok &= check("pps", 44100, 48000, 0);
+	ok &= check("hbs", 44100, 4 * 44100, 0);
+	ok &= check("fixed", 44100, 48000, FSRC_FIXED);
+	ok &= check("mixed", 44100, 48000, FSRC_MIXED);
+
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,240 @@
+/*    
+	Copyright (C) 2009 Szymon Modzelewski
+
+	This file is part of libfsrc.
+
+    libfsrc is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libfsrc is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libfsrc.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+/*
+	regression checks against the converter's own paths: push and pull 
+	give what read, process and write do, an async converter keeps its 
+	latency across the swap, fixed and mixed stay close to double, and 
+	halfband stages agree with polyphase ones
+*/
+#include <fsrc.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+
+#define RATE	44100
+#define INPUT	(2 * RATE)
+#define BLOCK	512
+
+enum { 
+	READ_WRITE, 
+	PUSH_PULL, 
+	ASYNC,			/* swaps the final design in half way through */
+	ASYNC_READY		/* waits for the final design before starting */
+};
+
+typedef struct output {
+	double *data;
+	size_t size;
+} output;
+
+static double *input;
+
+/* a 997 Hz sine at -6 dB plus some noise, which makes misaligned outputs stand out */
+static void make_input(void)
+{
+	input = malloc(INPUT * sizeof(double));
+	unsigned seed = 1;
+	for(size_t i = 0; i < INPUT; ++i) {
+		seed = seed * 1103515245 + 12345;
+		input[i] = 0.5 * sin(2 * M_PI * 997 * i / RATE) + 0.01 * ((seed >> 16) / 32768.0 - 1);
+	}
+}
+
+static int convert(fsrc_ull orate, fsrc_preset pre, int flags, int mode, output *out)
+{
+	fsrc_ratio r;
+	fsrc_spec spec;
+	fsrc_converter *src;
+	fsrc_err err;
+
+	fsrc_freq_ratio(RATE, orate, &r);
+	fsrc_load_preset(r, pre, &spec);
+	spec.isize = BLOCK;
+	spec.osize = BLOCK;
+	spec.flags = flags;
+
+	/* no cache, so an async converter has to start on stand-ins */
+	if(mode == ASYNC || mode == ASYNC_READY)
+		err = fsrc_create_async(0, &src, &spec, 1, 0, 0);
+	else
+		err = fsrc_create(0, &src, &spec, 1);
+	if(err != FSRC_S_OK) {
+		printf("fsrc_create failed (%d)\n", err);
+		return 0;
+	}
+
+	if(mode == ASYNC_READY)
+		fsrc_async_wait(src);
+
+	size_t cap = (size_t)((double)INPUT * orate / RATE) + 4 * BLOCK;
+	out->data = malloc(cap * sizeof(double));
+	out->size = 0;
+
+	size_t pos = 0;
+	int ended = 0;
+
+	for(;;) {
+		if(mode == ASYNC && pos >= INPUT / 2) {
+			fsrc_async_wait(src);
+			mode = READ_WRITE;
+		}
+
+		if(pos < INPUT) {
+			fsrc_bufdesc in = { 0 };
+			in.size = INPUT - pos < BLOCK ? INPUT - pos : BLOCK;
+			in.data = input + pos;
+			in.fmt = fsrc_f64;
+			pos += mode == PUSH_PULL ? fsrc_push(src, &in) : fsrc_read(src, &in);
+		} else if(!ended) {
+			fsrc_end(src);
+			ended = 1;
+		}
+
+		fsrc_bufdesc o = { 0 };
+		o.size = cap - out->size < BLOCK ? cap - out->size : BLOCK;
+		o.data = out->data + out->size;
+		o.fmt = fsrc_f64;
+
+		if(mode == PUSH_PULL) {
+			size_t n = fsrc_pull(src, &o);
+			out->size += n;
+			if(ended && n < o.size)
+				break;
+		} else {
+			err = fsrc_process(src);
+			if(err == FSRC_S_END)
+				break;
+			if(err < 0) {
+				printf("fsrc_process failed (%d)\n", err);
+				fsrc_destroy(src);
+				return 0;
+			}
+			out->size += fsrc_write(src, &o);
+		}
+	}
+
+	fsrc_destroy(src);
+
+	return 1;
+}
+
+/* 
+	signal to difference ratio in dB of b against a, with b shifted by lag, 
+	over [from, to). inf if they're the same
+*/
+static double snr(const output *a, const output *b, long lag, size_t from, size_t to)
+{
+	double s = 0, e = 0;
+	for(size_t i = from; i < to; ++i) {
+		double d = a->data[i] - b->data[i + lag];
+		s += a->data[i] * a->data[i];
+		e += d * d;
+	}
+	return e == 0 ? INFINITY : 10 * log10(s / e);
+}
+
+/* 
+	b against a, from a fraction of the way in. the latency can differ by up 
+	to slack samples, the best lag is used. what's left after fsrc_end 
+	depends on what's buffered when it's called, so the lengths can differ, 
+	only the part both have is compared
+*/
+static int compare(const char *name, const output *a, const output *b, double at, long slack, double min)
+{
+	size_t size = a->size < b->size ? a->size : b->size;
+	size_t from = (size_t)(at * size) + slack;
+	size_t to = size - slack;
+
+	long best = 0;
+	double db = -INFINITY;
+	for(long lag = -slack; lag <= slack; ++lag) {
+		double x = snr(a, b, lag, from, to);
+		if(x > db) {
+			db = x;
+			best = lag;
+		}
+	}
+
+	int ok = db >= min;
+
+	printf("%s: %.1f dB at lag %ld, %s\n", name, db, best, ok ? "ok" : "FAILED");
+
+	return ok;
+}
+
+static void release(output *o)
+{
+	free(o->data);
+	o->data = 0;
+}
+
+int main()
+{
+	output ref, out;
+	int ok = 1;
+
+	make_input();
+
+	/* push and pull run the same stages */
+	if(!convert(48000, FSRC_MQ_16, 0, READ_WRITE, &ref) || !convert(48000, FSRC_MQ_16, 0, PUSH_PULL, &out))
+		return EXIT_FAILURE;
+	ok &= compare("push/pull", &ref, &out, 0, 0, INFINITY);
+	release(&out);
+	release(&ref);
+
+	/* fixed and mixed against double, the same filters */
+	if(!convert(48000, FSRC_MQ_16, FSRC_DOUBLE, READ_WRITE, &ref))
+		return EXIT_FAILURE;
+	if(!convert(48000, FSRC_MQ_16, FSRC_FIXED, READ_WRITE, &out))
+		return EXIT_FAILURE;
+	ok &= compare("fixed", &ref, &out, 0, 0, 100);
+	release(&out);
+	if(!convert(48000, FSRC_MQ_16, FSRC_MIXED, READ_WRITE, &out))
+		return EXIT_FAILURE;
+	ok &= compare("mixed", &ref, &out, 0, 0, 100);
+	release(&out);
+	release(&ref);
+
+	/* 
+		the final filters are padded to the stand-ins' length, so the 
+		latency is the same on both sides of the swap. the stand-ins are 
+		only roughly to spec, after the swap it's the same as a converter 
+		that had the final design from the start
+	*/
+	if(!convert(48000, FSRC_MQ_16, 0, ASYNC_READY, &ref) || !convert(48000, FSRC_MQ_16, 0, ASYNC, &out))
+		return EXIT_FAILURE;
+	ok &= compare("async stand-in", &ref, &out, 0, 0, 60);
+	ok &= compare("async swapped", &ref, &out, 0.75, 0, INFINITY);
+	release(&out);
+	release(&ref);
+
+	/* 4:1 has a halfband stage in float, fixed has none. the latencies differ a bit */
+	if(!convert(4 * RATE, FSRC_MQ_16, 0, READ_WRITE, &ref) || !convert(4 * RATE, FSRC_MQ_16, FSRC_FIXED, READ_WRITE, &out))
+		return EXIT_FAILURE;
+	ok &= compare("halfband", &ref, &out, 0, 16, 80);
+	release(&out);
+	release(&ref);
+
+	free(input);
+
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}